@@ -118,12 +118,11 @@ const char *const forced_keyframes_const_names[] = {
 };
 
 static void do_video_stats(OutputStream *ost, int frame_size);
+static void update_video_stats(OutputStream *ost);
 static int64_t getutime(void);
 static int64_t getmaxrss(void);
 
 static int run_as_daemon  = 0;
-static int nb_frames_dup = 0;
-static int nb_frames_drop = 0;
 static int64_t decode_error_stat[2];
 
 static int current_time;
@@ -146,6 +145,8 @@ int         nb_output_files   = 0;
 FilterGraph **filtergraphs;
 int        nb_filtergraphs;
 
+AVExecutor *shared_executor;
+
 #if HAVE_TERMIOS_H
 
 /* init terminal so that we can grab keys */
@@ -155,6 +156,8 @@ static int restore_tty;
 
 #if HAVE_PTHREADS
 static void free_input_threads(void);
+static int in_output_thread(void);
+static void free_output_threads(void);
 #endif
 
 /* sub2video hack:
@@ -427,6 +430,16 @@ static void ffmpeg_cleanup(int ret)
 {
     int i, j;
 
+#if HAVE_PTHREADS
+    if (in_output_thread()) {
+        /* exit_program() called while encoding, the main thread may still
+         * be using everything freed below */
+        term_exit();
+        return;
+    }
+    free_output_threads();
+#endif
+
     if (do_benchmark) {
         int maxrss = getmaxrss() / 1024;
         printf("bench: maxrss=%ikB\n", maxrss);
@@ -513,6 +526,8 @@ static void ffmpeg_cleanup(int ret)
         av_freep(&input_streams[i]);
     }
 
+    av_executor_free(&shared_executor);
+
     if (vstats_file)
         fclose(vstats_file);
     av_freep(&vstats_filename);
@@ -575,12 +590,35 @@ static void update_benchmark(const char *fmt, ...)
     }
 }
 
+/* With an output thread, the lock of the file also guards the state of its
+ * streams both threads look at: finished, frame_number, recording_time and
+ * everything the muxer updates. */
+static void lock_output_file(OutputFile *of)
+{
+#if HAVE_PTHREADS
+    if (of->out_thread_queue)
+        pthread_mutex_lock(&of->lock);
+#endif
+}
+
+static void unlock_output_file(OutputFile *of)
+{
+#if HAVE_PTHREADS
+    if (of->out_thread_queue)
+        pthread_mutex_unlock(&of->lock);
+#endif
+}
+
 static void close_all_output_streams(OutputStream *ost, OSTFinished this_stream, OSTFinished others)
 {
     int i;
     for (i = 0; i < nb_output_streams; i++) {
         OutputStream *ost2 = output_streams[i];
+        OutputFile    *of2 = output_files[ost2->file_index];
+
+        lock_output_file(of2);
         ost2->finished |= ost == ost2 ? this_stream : others;
+        unlock_output_file(of2);
     }
 }
 
@@ -588,6 +626,7 @@ static void write_frame(AVFormatContext *s, AVPacket *pkt, OutputStream *ost)
 {
     AVBitStreamFilterContext *bsfc = ost->bitstream_filters;
     AVCodecContext          *avctx = ost->st->codec;
+    OutputFile                 *of = output_files[ost->file_index];
     int ret;
 
     if (!ost->st->codec->extradata_size && ost->enc_ctx->extradata_size) {
@@ -614,7 +653,9 @@ static void write_frame(AVFormatContext *s, AVPacket *pkt, OutputStream *ost)
             av_free_packet(pkt);
             return;
         }
+        lock_output_file(of);
         ost->frame_number++;
+        unlock_output_file(of);
     }
 
     if (bsfc)
@@ -714,7 +755,9 @@ static void write_frame(AVFormatContext *s, AVPacket *pkt, OutputStream *ost)
               );
     }
 
+    lock_output_file(of);
     ret = av_interleaved_write_frame(s, pkt);
+    unlock_output_file(of);
     if (ret < 0) {
         print_error("av_interleaved_write_frame()", ret);
         main_return_code = 1;
@@ -723,23 +766,58 @@ static void write_frame(AVFormatContext *s, AVPacket *pkt, OutputStream *ost)
     av_free_packet(pkt);
 }
 
+#if HAVE_PTHREADS
+/* A filtered frame on its way to the output thread of its file, no frame
+ * closes the stream once the frames queued before are encoded. */
+typedef struct OutputFrame {
+    OutputStream *ost;
+    AVFrame *frame;
+    double float_pts;
+    AVRational frame_rate;      /* frame rate of the buffersink */
+} OutputFrame;
+#endif
+
 static void close_output_stream(OutputStream *ost)
 {
     OutputFile *of = output_files[ost->file_index];
 
+#if HAVE_PTHREADS
+    /* the end time for -shortest depends on the frames still queued */
+    if (of->out_thread_queue && ost->filter && !in_output_thread()) {
+        OutputFrame f = { ost };
+        int finished;
+
+        lock_output_file(of);
+        finished = ost->finished & ENCODER_FINISHED;
+        ost->finished |= ENCODER_FINISHED;
+        unlock_output_file(of);
+        /* not under the lock, the thread may need it to make room */
+        if (!finished)
+            av_thread_message_queue_send(of->out_thread_queue, &f, 0);
+        return;
+    }
+#endif
+
+    lock_output_file(of);
     ost->finished |= ENCODER_FINISHED;
     if (of->shortest) {
         int64_t end = av_rescale_q(ost->sync_opts - ost->first_pts, ost->enc_ctx->time_base, AV_TIME_BASE_Q);
         of->recording_time = FFMIN(of->recording_time, end);
     }
+    unlock_output_file(of);
 }
 
 static int check_recording_time(OutputStream *ost)
 {
     OutputFile *of = output_files[ost->file_index];
+    int64_t recording_time;
 
-    if (of->recording_time != INT64_MAX &&
-        av_compare_ts(ost->sync_opts - ost->first_pts, ost->enc_ctx->time_base, of->recording_time,
+    lock_output_file(of);
+    recording_time = of->recording_time;
+    unlock_output_file(of);
+
+    if (recording_time != INT64_MAX &&
+        av_compare_ts(ost->sync_opts - ost->first_pts, ost->enc_ctx->time_base, recording_time,
                       AV_TIME_BASE_Q) >= 0) {
         close_output_stream(ost);
         return 0;
@@ -883,7 +961,8 @@ static void do_subtitle_out(AVFormatContext *s,
 static void do_video_out(AVFormatContext *s,
                          OutputStream *ost,
                          AVFrame *next_picture,
-                         double sync_ipts)
+                         double sync_ipts,
+                         AVRational frame_rate)
 {
     int ret, format_video_sync;
     AVPacket pkt;
@@ -894,14 +973,12 @@ static void do_video_out(AVFormatContext *s,
     double duration = 0;
     int frame_size = 0;
     InputStream *ist = NULL;
-    AVFilterContext *filter = ost->filter->filter;
 
     if (ost->source_index >= 0)
         ist = input_streams[ost->source_index];
 
-    if (filter->inputs[0]->frame_rate.num > 0 &&
-        filter->inputs[0]->frame_rate.den > 0)
-        duration = 1/(av_q2d(filter->inputs[0]->frame_rate) * av_q2d(enc->time_base));
+    if (frame_rate.num > 0 && frame_rate.den > 0)
+        duration = 1/(av_q2d(frame_rate) * av_q2d(enc->time_base));
 
     if(ist && ist->st->start_time != AV_NOPTS_VALUE && ist->st->first_dts != AV_NOPTS_VALUE && ost->frame_rate.num)
         duration = FFMIN(duration, 1/(av_q2d(ost->frame_rate) * av_q2d(enc->time_base)));
@@ -989,7 +1066,7 @@ static void do_video_out(AVFormatContext *s,
     nb_frames = FFMIN(nb_frames, ost->max_frames - ost->frame_number);
     nb0_frames = FFMIN(nb0_frames, nb_frames);
     if (nb0_frames == 0 && ost->last_droped) {
-        nb_frames_drop++;
+        ost->nb_frames_drop++;
         av_log(NULL, AV_LOG_VERBOSE,
                "*** dropping frame %d from stream %d at ts %"PRId64"\n",
                ost->frame_number, ost->st->index, ost->last_frame->pts);
@@ -997,10 +1074,10 @@ static void do_video_out(AVFormatContext *s,
     if (nb_frames > (nb0_frames && ost->last_droped) + (nb_frames > nb0_frames)) {
         if (nb_frames > dts_error_threshold * 30) {
             av_log(NULL, AV_LOG_ERROR, "%d frame duplication too large, skipping\n", nb_frames - 1);
-            nb_frames_drop++;
+            ost->nb_frames_drop++;
             return;
         }
-        nb_frames_dup += nb_frames - (nb0_frames && ost->last_droped) - (nb_frames > nb0_frames);
+        ost->nb_frames_dup += nb_frames - (nb0_frames && ost->last_droped) - (nb_frames > nb0_frames);
         av_log(NULL, AV_LOG_VERBOSE, "*** %d dup!\n", nb_frames - 1);
     }
     ost->last_droped = nb_frames == nb0_frames;
@@ -1111,6 +1188,7 @@ static void do_video_out(AVFormatContext *s,
             av_log(NULL, AV_LOG_FATAL, "Video encoding failed\n");
             exit_program(1);
         }
+        update_video_stats(ost);
 
         if (got_packet) {
             if (debug_ts) {
@@ -1147,7 +1225,9 @@ static void do_video_out(AVFormatContext *s,
      * But there may be reordering, so we can't throw away frames on encoder
      * flush, we need to limit them here, before they go into encoder.
      */
+    lock_output_file(output_files[ost->file_index]);
     ost->frame_number++;
+    unlock_output_file(output_files[ost->file_index]);
 
     if (vstats_filename && frame_size)
         do_video_stats(ost, frame_size);
@@ -1164,9 +1244,27 @@ static double psnr(double d)
     return -10.0 * log(d) / log(10.0);
 }
 
+/* Publish the stats of the frame just encoded. print_report() reads them on
+ * the main thread while the output thread encodes the next frame. */
+static void update_video_stats(OutputStream *ost)
+{
+    AVCodecContext *enc = ost->enc_ctx;
+    int i;
+
+    if (!enc->coded_frame)
+        return;
+    lock_output_file(output_files[ost->file_index]);
+    ost->quality   = enc->coded_frame->quality;
+    ost->pict_type = enc->coded_frame->pict_type;
+    for (i = 0; i < FF_ARRAY_ELEMS(ost->error); i++)
+        ost->error[i] = enc->coded_frame->error[i];
+    unlock_output_file(output_files[ost->file_index]);
+}
+
 static void do_video_stats(OutputStream *ost, int frame_size)
 {
     AVCodecContext *enc;
+    AVBPrint line;
     int frame_number;
     double ti1, bitrate, avg_bitrate;
 
@@ -1181,12 +1279,15 @@ static void do_video_stats(OutputStream *ost, int frame_size)
 
     enc = ost->enc_ctx;
     if (enc->codec_type == AVMEDIA_TYPE_VIDEO) {
+        /* the output threads of several files share vstats_file, so build
+         * the line first and write it with a single call */
+        av_bprint_init(&line, 0, 1);
         frame_number = ost->st->nb_frames;
-        fprintf(vstats_file, "frame= %5d q= %2.1f ", frame_number, enc->coded_frame->quality / (float)FF_QP2LAMBDA);
+        av_bprintf(&line, "frame= %5d q= %2.1f ", frame_number, ost->quality / (float)FF_QP2LAMBDA);
         if (enc->flags&CODEC_FLAG_PSNR)
-            fprintf(vstats_file, "PSNR= %6.2f ", psnr(enc->coded_frame->error[0] / (enc->width * enc->height * 255.0 * 255.0)));
+            av_bprintf(&line, "PSNR= %6.2f ", psnr(ost->error[0] / (enc->width * enc->height * 255.0 * 255.0)));
 
-        fprintf(vstats_file,"f_size= %6d ", frame_size);
+        av_bprintf(&line, "f_size= %6d ", frame_size);
         /* compute pts value */
         ti1 = av_stream_get_end_pts(ost->st) * av_q2d(ost->st->time_base);
         if (ti1 < 0.01)
@@ -1194,9 +1295,11 @@ static void do_video_stats(OutputStream *ost, int frame_size)
 
         bitrate     = (frame_size * 8) / av_q2d(enc->time_base) / 1000.0;
         avg_bitrate = (double)(ost->data_size * 8) / ti1 / 1000.0;
-        fprintf(vstats_file, "s_size= %8.0fkB time= %0.3f br= %7.1fkbits/s avg_br= %7.1fkbits/s ",
-               (double)ost->data_size / 1024, ti1, bitrate, avg_bitrate);
-        fprintf(vstats_file, "type= %c\n", av_get_picture_type_char(enc->coded_frame->pict_type));
+        av_bprintf(&line, "s_size= %8.0fkB time= %0.3f br= %7.1fkbits/s avg_br= %7.1fkbits/s ",
+                   (double)ost->data_size / 1024, ti1, bitrate, avg_bitrate);
+        av_bprintf(&line, "type= %c\n", av_get_picture_type_char(ost->pict_type));
+        fputs(line.str, vstats_file);
+        av_bprint_finalize(&line, NULL);
     }
 }
 
@@ -1205,21 +1308,156 @@ static void finish_output_stream(OutputStream *ost)
     OutputFile *of = output_files[ost->file_index];
     int i;
 
+    lock_output_file(of);
     ost->finished = ENCODER_FINISHED | MUXER_FINISHED;
 
     if (of->shortest) {
         for (i = 0; i < of->ctx->nb_streams; i++)
             output_streams[of->ost_index + i]->finished = ENCODER_FINISHED | MUXER_FINISHED;
     }
+    unlock_output_file(of);
+}
+
+static void encode_frame(OutputStream *ost, AVFrame *frame, double float_pts,
+                         AVRational frame_rate)
+{
+    OutputFile *of = output_files[ost->file_index];
+    AVCodecContext *enc = ost->enc_ctx;
+
+    switch (enc->codec_type) {
+    case AVMEDIA_TYPE_VIDEO:
+        if (!ost->frame_aspect_ratio.num)
+            enc->sample_aspect_ratio = frame->sample_aspect_ratio;
+
+        if (debug_ts) {
+            av_log(NULL, AV_LOG_INFO, "filter -> pts:%s pts_time:%s exact:%f time_base:%d/%d\n",
+                    av_ts2str(frame->pts), av_ts2timestr(frame->pts, &enc->time_base),
+                    float_pts,
+                    enc->time_base.num, enc->time_base.den);
+        }
+
+        do_video_out(of->ctx, ost, frame, float_pts, frame_rate);
+        break;
+    case AVMEDIA_TYPE_AUDIO:
+        if (!(enc->codec->capabilities & CODEC_CAP_PARAM_CHANGE) &&
+            enc->channels != av_frame_get_channels(frame)) {
+            av_log(NULL, AV_LOG_ERROR,
+                   "Audio filter graph output is not normalized and encoder does not support parameter changes\n");
+            break;
+        }
+        do_audio_out(of->ctx, ost, frame);
+        break;
+    default:
+        // TODO support subtitle filters
+        av_assert0(0);
+    }
+}
+
+#if HAVE_PTHREADS
+static void *output_thread(void *arg)
+{
+    OutputFile *of = arg;
+    OutputFrame f;
+
+    while (av_thread_message_queue_recv(of->out_thread_queue, &f, 0) >= 0) {
+        if (!f.frame) {
+            close_output_stream(f.ost);
+            continue;
+        }
+        encode_frame(f.ost, f.frame, f.float_pts, f.frame_rate);
+        av_frame_free(&f.frame);
+    }
+
+    return NULL;
 }
 
+static int in_output_thread(void)
+{
+    int i;
+
+    for (i = 0; i < nb_output_files; i++) {
+        OutputFile *of = output_files[i];
+
+        if (of && of->out_thread_queue &&
+            pthread_equal(pthread_self(), of->thread))
+            return 1;
+    }
+    return 0;
+}
+
+static void free_output_threads(void)
+{
+    int i;
+
+    for (i = 0; i < nb_output_files; i++) {
+        OutputFile *of = output_files[i];
+
+        if (!of || !of->out_thread_queue)
+            continue;
+        /* the thread encodes the frames still queued before it stops */
+        av_thread_message_queue_set_err_recv(of->out_thread_queue, AVERROR_EOF);
+        pthread_join(of->thread, NULL);
+        pthread_mutex_destroy(&of->lock);
+        av_thread_message_queue_free(&of->out_thread_queue);
+    }
+}
+
+static int init_output_threads(void)
+{
+    int i, j, ret;
+
+    if (!stage_threads)
+        return 0;
+
+    /* opened here rather than by the first frame, which several threads
+     * could encode at once */
+    if (vstats_filename && !vstats_file) {
+        vstats_file = fopen(vstats_filename, "w");
+        if (!vstats_file) {
+            ret = AVERROR(errno);
+            av_log(NULL, AV_LOG_ERROR, "Cannot open %s: %s\n",
+                   vstats_filename, av_err2str(ret));
+            return ret;
+        }
+    }
+
+    for (i = 0; i < nb_output_files; i++) {
+        OutputFile *of = output_files[i];
+        int nb_filtered = 0;
+
+        /* streams without a filtergraph are still muxed by the main thread */
+        for (j = 0; j < of->ctx->nb_streams; j++)
+            nb_filtered += !!output_streams[of->ost_index + j]->filter;
+        if (!nb_filtered)
+            continue;
+
+        ret = av_thread_message_queue_alloc(&of->out_thread_queue,
+                                            8, sizeof(OutputFrame));
+        if (ret < 0)
+            return ret;
+        pthread_mutex_init(&of->lock, NULL);
+
+        if ((ret = pthread_create(&of->thread, NULL, output_thread, of))) {
+            av_log(NULL, AV_LOG_ERROR, "pthread_create failed: %s. Try to increase `ulimit -v` or decrease `ulimit -s`.\n", strerror(ret));
+            pthread_mutex_destroy(&of->lock);
+            av_thread_message_queue_free(&of->out_thread_queue);
+            return AVERROR(ret);
+        }
+    }
+    return 0;
+}
+#endif
+
 /**
  * Get and encode new output from any of the filtergraphs, without causing
  * activity.
  *
+ * @param drain first wait for the filters running on other threads to finish
+ *              the frames already sent to the filtergraphs, so that the output
+ *              is the same as with all filters on this thread
  * @return  0 for success, <0 for severe errors
  */
-static int reap_filters(void)
+static int reap_filters(int drain)
 {
     AVFrame *filtered_frame = NULL;
     int i;
@@ -1230,7 +1468,7 @@ static int reap_filters(void)
         OutputFile    *of = output_files[ost->file_index];
         AVFilterContext *filter;
         AVCodecContext *enc = ost->enc_ctx;
-        int ret = 0;
+        int ret = 0, finished;
 
         if (!ost->filter)
             continue;
@@ -1244,7 +1482,8 @@ static int reap_filters(void)
         while (1) {
             double float_pts = AV_NOPTS_VALUE; // this is identical to filtered_frame.pts but with higher precision
             ret = av_buffersink_get_frame_flags(filter, filtered_frame,
-                                               AV_BUFFERSINK_FLAG_NO_REQUEST);
+                                               AV_BUFFERSINK_FLAG_NO_REQUEST |
+                                               (drain ? AV_BUFFERSINK_FLAG_DRAIN : 0));
             if (ret < 0) {
                 if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
                     av_log(NULL, AV_LOG_WARNING,
@@ -1252,7 +1491,10 @@ static int reap_filters(void)
                 }
                 break;
             }
-            if (ost->finished) {
+            lock_output_file(of);
+            finished = ost->finished;
+            unlock_output_file(of);
+            if (finished) {
                 av_frame_unref(filtered_frame);
                 continue;
             }
@@ -1276,34 +1518,25 @@ static int reap_filters(void)
             //if (ost->source_index >= 0)
             //    *filtered_frame= *input_streams[ost->source_index]->decoded_frame; //for me_threshold
 
-            switch (filter->inputs[0]->type) {
-            case AVMEDIA_TYPE_VIDEO:
-                if (!ost->frame_aspect_ratio.num)
-                    enc->sample_aspect_ratio = filtered_frame->sample_aspect_ratio;
-
-                if (debug_ts) {
-                    av_log(NULL, AV_LOG_INFO, "filter -> pts:%s pts_time:%s exact:%f time_base:%d/%d\n",
-                            av_ts2str(filtered_frame->pts), av_ts2timestr(filtered_frame->pts, &enc->time_base),
-                            float_pts,
-                            enc->time_base.num, enc->time_base.den);
-                }
+#if HAVE_PTHREADS
+            if (of->out_thread_queue) {
+                OutputFrame f = { ost, av_frame_alloc(), float_pts,
+                                  filter->inputs[0]->frame_rate };
 
-                do_video_out(of->ctx, ost, filtered_frame, float_pts);
-                break;
-            case AVMEDIA_TYPE_AUDIO:
-                if (!(enc->codec->capabilities & CODEC_CAP_PARAM_CHANGE) &&
-                    enc->channels != av_frame_get_channels(filtered_frame)) {
-                    av_log(NULL, AV_LOG_ERROR,
-                           "Audio filter graph output is not normalized and encoder does not support parameter changes\n");
-                    break;
+                if (!f.frame)
+                    return AVERROR(ENOMEM);
+                av_frame_move_ref(f.frame, filtered_frame);
+                ret = av_thread_message_queue_send(of->out_thread_queue, &f, 0);
+                if (ret < 0) {
+                    av_frame_free(&f.frame);
+                    return ret;
                 }
-                do_audio_out(of->ctx, ost, filtered_frame);
-                break;
-            default:
-                // TODO support subtitle filters
-                av_assert0(0);
+                continue;
             }
+#endif
 
+            encode_frame(ost, filtered_frame, float_pts,
+                         filter->inputs[0]->frame_rate);
             av_frame_unref(filtered_frame);
         }
     }
@@ -1428,6 +1661,7 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
     int64_t total_size;
     AVCodecContext *enc;
     int frame_number, vid, i;
+    int nb_frames_dup = 0, nb_frames_drop = 0;
     double bitrate;
     int64_t pts = INT64_MIN;
     static int64_t last_time = -1;
@@ -1450,9 +1684,11 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
 
     oc = output_files[0]->ctx;
 
+    lock_output_file(output_files[0]);
     total_size = avio_size(oc->pb);
     if (total_size <= 0) // FIXME improve avio_size() so it works with non seekable output too
         total_size = avio_tell(oc->pb);
+    unlock_output_file(output_files[0]);
 
     buf[0] = '\0';
     vid = 0;
@@ -1461,8 +1697,9 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
         float q = -1;
         ost = output_streams[i];
         enc = ost->enc_ctx;
+        lock_output_file(output_files[ost->file_index]);
         if (!ost->stream_copy && enc->coded_frame)
-            q = enc->coded_frame->quality / (float)FF_QP2LAMBDA;
+            q = ost->quality / (float)FF_QP2LAMBDA;
         if (vid && enc->codec_type == AVMEDIA_TYPE_VIDEO) {
             snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "q=%2.1f ", q);
             av_bprintf(&buf_script, "stream_%d_%d_q=%.1f\n",
@@ -1501,7 +1738,7 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
                         error = enc->error[j];
                         scale = enc->width * enc->height * 255.0 * 255.0 * frame_number;
                     } else {
-                        error = enc->coded_frame->error[j];
+                        error = ost->error[j];
                         scale = enc->width * enc->height * 255.0 * 255.0;
                     }
                     if (j)
@@ -1524,8 +1761,11 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
         if (av_stream_get_end_pts(ost->st) != AV_NOPTS_VALUE)
             pts = FFMAX(pts, av_rescale_q(av_stream_get_end_pts(ost->st),
                                           ost->st->time_base, AV_TIME_BASE_Q));
+        nb_frames_dup  += ost->nb_frames_dup;
+        nb_frames_drop += ost->nb_frames_drop;
         if (is_last_report)
             nb_frames_drop += ost->last_droped;
+        unlock_output_file(output_files[ost->file_index]);
     }
 
     secs = FFABS(pts) / AV_TIME_BASE;
@@ -1643,6 +1883,8 @@ static void flush_encoders(void)
                     av_log(NULL, AV_LOG_FATAL, "%s encoding failed\n", desc);
                     exit_program(1);
                 }
+                if (enc->codec_type == AVMEDIA_TYPE_VIDEO)
+                    update_video_stats(ost);
                 if (ost->logfile && enc->stats_out) {
                     fprintf(ost->logfile, "%s", enc->stats_out);
                 }
@@ -1675,11 +1917,15 @@ static int check_output_constraints(InputStream *ist, OutputStream *ost)
 {
     OutputFile *of = output_files[ost->file_index];
     int ist_index  = input_files[ist->file_index]->ist_index + ist->st->index;
+    int finished;
 
     if (ost->source_index != ist_index)
         return 0;
 
-    if (ost->finished)
+    lock_output_file(of);
+    finished = ost->finished;
+    unlock_output_file(of);
+    if (finished)
         return 0;
 
     if (of->start_time != AV_NOPTS_VALUE && ist->pts < of->start_time)
@@ -1695,6 +1941,7 @@ static void do_streamcopy(InputStream *ist, OutputStream *ost, const AVPacket *p
     int64_t start_time = (of->start_time == AV_NOPTS_VALUE) ? 0 : of->start_time;
     int64_t ost_tb_start_time = av_rescale_q(start_time, AV_TIME_BASE_Q, ost->st->time_base);
     int64_t ist_tb_start_time = av_rescale_q(start_time, AV_TIME_BASE_Q, ist->st->time_base);
+    int64_t recording_time;
     AVPicture pict;
     AVPacket opkt;
 
@@ -1714,8 +1961,11 @@ static void do_streamcopy(InputStream *ist, OutputStream *ost, const AVPacket *p
             return;
     }
 
-    if (of->recording_time != INT64_MAX &&
-        ist->pts >= of->recording_time + start_time) {
+    lock_output_file(of);
+    recording_time = of->recording_time;
+    unlock_output_file(of);
+    if (recording_time != INT64_MAX &&
+        ist->pts >= recording_time + start_time) {
         close_output_stream(ost);
         return;
     }
@@ -2410,6 +2660,7 @@ static int init_input_stream(int ist_index, char *error, int error_len)
 
         if (!av_dict_get(ist->decoder_opts, "threads", NULL, 0))
             av_dict_set(&ist->decoder_opts, "threads", "auto", 0);
+        av_codec_set_executor(ist->dec_ctx, shared_executor);
         if ((ret = avcodec_open2(ist->dec_ctx, codec, &ist->decoder_opts)) < 0) {
             if (ret == AVERROR_EXPERIMENTAL)
                 abort_codec_experimental(codec, 0);
@@ -3025,6 +3276,7 @@ static int transcode_init(void)
             }
             if (!av_dict_get(ost->encoder_opts, "threads", NULL, 0))
                 av_dict_set(&ost->encoder_opts, "threads", "auto", 0);
+            av_codec_set_executor(ost->enc_ctx, shared_executor);
             av_dict_set(&ost->encoder_opts, "side_data_only_packets", "1", 0);
 
             if ((ret = avcodec_open2(ost->enc_ctx, codec, &ost->encoder_opts)) < 0) {
@@ -3215,12 +3467,20 @@ static int need_output(void)
         OutputStream *ost    = output_streams[i];
         OutputFile *of       = output_files[ost->file_index];
         AVFormatContext *os  = output_files[ost->file_index]->ctx;
+        int finished, frame_number;
+
+        lock_output_file(of);
+        finished     = ost->finished ||
+                       (os->pb && avio_tell(os->pb) >= of->limit_filesize);
+        frame_number = ost->frame_number;
+        unlock_output_file(of);
 
-        if (ost->finished ||
-            (os->pb && avio_tell(os->pb) >= of->limit_filesize))
+        if (finished)
             continue;
-        if (ost->frame_number >= ost->max_frames) {
+        if (frame_number >= ost->max_frames) {
             int j;
+            /* the other streams end with the frames sent for filtering so far */
+            reap_filters(1);
             for (j = 0; j < of->ctx->nb_streams; j++)
                 close_output_stream(output_streams[of->ost_index + j]);
             continue;
@@ -3245,9 +3505,16 @@ static OutputStream *choose_output(void)
 
     for (i = 0; i < nb_output_streams; i++) {
         OutputStream *ost = output_streams[i];
-        int64_t opts = av_rescale_q(ost->st->cur_dts, ost->st->time_base,
-                                    AV_TIME_BASE_Q);
-        if (!ost->finished && opts < opts_min) {
+        OutputFile    *of = output_files[ost->file_index];
+        int64_t opts;
+        int finished;
+
+        lock_output_file(of);
+        opts     = av_rescale_q(ost->st->cur_dts, ost->st->time_base,
+                                AV_TIME_BASE_Q);
+        finished = ost->finished;
+        unlock_output_file(of);
+        if (!finished && opts < opts_min) {
             opts_min = opts;
             ost_min  = ost->unavailable ? NULL : ost;
         }
@@ -3410,14 +3677,16 @@ static int init_input_threads(void)
 {
     int i, ret;
 
-    if (nb_input_files == 1)
+    if (nb_input_files == 1 && !stage_threads)
         return 0;
 
     for (i = 0; i < nb_input_files; i++) {
         InputFile *f = input_files[i];
 
-        if (f->ctx->pb ? !f->ctx->pb->seekable :
-            strcmp(f->ctx->iformat->name, "lavfi"))
+        /* a single input can be waited for */
+        if (nb_input_files > 1 &&
+            (f->ctx->pb ? !f->ctx->pb->seekable :
+             strcmp(f->ctx->iformat->name, "lavfi")))
             f->non_blocking = 1;
         ret = av_thread_message_queue_alloc(&f->in_thread_queue,
                                             8, sizeof(AVPacket));
@@ -3455,7 +3724,7 @@ static int get_input_packet(InputFile *f, AVPacket *pkt)
     }
 
 #if HAVE_PTHREADS
-    if (nb_input_files > 1)
+    if (f->in_thread_queue)
         return get_input_packet_mt(f, pkt);
 #endif
     return av_read_frame(f->ctx, pkt);
@@ -3521,8 +3790,12 @@ static int process_input(int file_index)
                 OutputStream *ost = output_streams[j];
 
                 if (ost->source_index == ifile->ist_index + i &&
-                    (ost->stream_copy || ost->enc->type == AVMEDIA_TYPE_SUBTITLE))
+                    (ost->stream_copy || ost->enc->type == AVMEDIA_TYPE_SUBTITLE)) {
+                    if (output_files[ost->file_index]->shortest &&
+                        (ret = reap_filters(1)) < 0)
+                        return ret;
                     finish_output_stream(ost);
+                }
             }
         }
 
@@ -3726,10 +3999,11 @@ static int transcode_from_filter(FilterGraph *graph, InputStream **best_ist)
     *best_ist = NULL;
     ret = avfilter_graph_request_oldest(graph->graph);
     if (ret >= 0)
-        return reap_filters();
+        return reap_filters(0);
 
     if (ret == AVERROR_EOF) {
-        ret = reap_filters();
+        /* with -shortest, closing the outputs ends the other streams too */
+        ret = reap_filters(1);
         for (i = 0; i < graph->nb_outputs; i++)
             close_output_stream(graph->outputs[i]->ost);
         return ret;
@@ -3798,7 +4072,7 @@ static int transcode_step(void)
     if (ret < 0)
         return ret == AVERROR_EOF ? 0 : ret;
 
-    return reap_filters();
+    return reap_filters(0);
 }
 
 /*
@@ -3825,6 +4099,8 @@ static int transcode(void)
 #if HAVE_PTHREADS
     if ((ret = init_input_threads()) < 0)
         goto fail;
+    if ((ret = init_output_threads()) < 0)
+        goto fail;
 #endif
 
     while (!received_sigterm) {
@@ -3864,6 +4140,9 @@ static int transcode(void)
             process_input_packet(ist, NULL);
         }
     }
+#if HAVE_PTHREADS
+    free_output_threads();
+#endif
     flush_encoders();
 
     term_exit();
@@ -3901,6 +4180,7 @@ static int transcode(void)
  fail:
 #if HAVE_PTHREADS
     free_input_threads();
+    free_output_threads();
 #endif
 
     if (output_streams) {
@@ -41,6 +41,7 @@
 #include "libavutil/avutil.h"
 #include "libavutil/dict.h"
 #include "libavutil/eval.h"
+#include "libavutil/executor.h"
 #include "libavutil/fifo.h"
 #include "libavutil/pixfmt.h"
 #include "libavutil/rational.h"
@@ -392,6 +393,8 @@ typedef struct OutputStream {
     AVFrame *filtered_frame;
     AVFrame *last_frame;
     int last_droped;
+    int nb_frames_dup;
+    int nb_frames_drop;
 
     /* video only */
     AVRational frame_rate;
@@ -446,6 +449,11 @@ typedef struct OutputStream {
     // number of frames/samples sent to the encoder
     uint64_t frames_encoded;
     uint64_t samples_encoded;
+    // quality, picture type and errors of the last encoded video frame,
+    // copied from coded_frame under OutputFile.lock by the encoding thread
+    int quality;
+    int pict_type;
+    uint64_t error[3];
 } OutputStream;
 
 typedef struct OutputFile {
@@ -457,6 +465,12 @@ typedef struct OutputFile {
     uint64_t limit_filesize; /* filesize limit expressed in bytes */
 
     int shortest;
+
+#if HAVE_PTHREADS
+    AVThreadMessageQueue *out_thread_queue;
+    pthread_t thread;           /* thread encoding the filtered frames of this file */
+    pthread_mutex_t lock;       /* serializes access to the muxer and the output state */
+#endif
 } OutputFile;
 
 extern InputStream **input_streams;
@@ -499,6 +513,11 @@ extern int stdin_interaction;
 extern int frame_bits_per_raw_sample;
 extern AVIOContext *progress_avio;
 extern float max_error_rate;
+extern int filter_nbthreads;
+extern int filter_pipeline;
+extern int shared_threads;
+extern int stage_threads;
+extern AVExecutor *shared_executor;
 extern int vdpau_api_ver;
 
 extern const AVIOInterruptCB int_cb;
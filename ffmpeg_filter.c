@@ -867,6 +867,10 @@ int configure_filtergraph(FilterGraph *fg)
     avfilter_graph_free(&fg->graph);
     if (!(fg->graph = avfilter_graph_alloc()))
         return AVERROR(ENOMEM);
+    fg->graph->nb_threads = filter_nbthreads;
+    fg->graph->executor   = shared_executor;
+    if (filter_pipeline || stage_threads)
+        fg->graph->thread_type |= AVFILTER_THREAD_FRAME;
 
     if (simple) {
         OutputStream *ost = fg->outputs[0]->ost;
@@ -102,6 +102,10 @@ int qp_hist           = 0;
 int stdin_interaction = 1;
 int frame_bits_per_raw_sample = 0;
 float max_error_rate  = 2.0/3;
+int filter_nbthreads  = 0;
+int filter_pipeline   = 0;
+int shared_threads    = 0;
+int stage_threads     = 0;
 
 
 static int intra_only         = 0;
@@ -2752,6 +2756,14 @@ int ffmpeg_parse_options(int argc, char **argv)
         goto fail;
     }
 
+    if (shared_threads > 0) {
+        ret = av_executor_alloc(&shared_executor, shared_threads);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_FATAL, "Error creating the shared thread pool: ");
+            goto fail;
+        }
+    }
+
     /* open input files */
     ret = open_files(&octx.groups[GROUP_INFILE], "input", open_input_file);
     if (ret < 0) {
@@ -2922,6 +2934,14 @@ const OptionDef options[] = {
         "read stream filtergraph description from a file", "filename" },
     { "reinit_filter",  HAS_ARG | OPT_INT | OPT_SPEC | OPT_INPUT,    { .off = OFFSET(reinit_filters) },
         "reinit filtergraph on input parameter changes", "" },
+    { "filter_threads", HAS_ARG | OPT_INT,                           { &filter_nbthreads },
+        "number of threads used by filtergraphs (0 for auto)", "" },
+    { "filter_pipeline", OPT_BOOL | OPT_EXPERT,                      { &filter_pipeline },
+        "run the filters of filtergraphs on separate threads" },
+    { "shared_threads", HAS_ARG | OPT_INT | OPT_EXPERT,              { &shared_threads },
+        "number of threads of a pool shared by the filtergraphs and the slice threads of codecs (0 to disable)", "" },
+    { "stage_threads",  OPT_BOOL | OPT_EXPERT,                       { &stage_threads },
+        "run demuxing, filtering and encoding on separate threads" },
     { "filter_complex", HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_filter_complex },
         "create a complex filtergraph", "graph_description" },
     { "lavfi",          HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_filter_complex },
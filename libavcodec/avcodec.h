@@ -35,6 +35,7 @@
 #include "libavutil/cpu.h"
 #include "libavutil/channel_layout.h"
 #include "libavutil/dict.h"
+#include "libavutil/executor.h"
 #include "libavutil/frame.h"
 #include "libavutil/log.h"
 #include "libavutil/pixfmt.h"
@@ -3134,6 +3135,27 @@ typedef struct AVCodecContext {
      * - decoding: set by user through AVOPtions (NO direct access)
      */
     char *codec_whitelist;
+
+    /**
+     * Shared thread pool to run the slice threads on, instead of threads
+     * owned by this context. Frame threading still uses threads of its own.
+     * The number of threads used by each execute is then still limited by
+     * thread_count, which defaults to the number of threads of the pool
+     * plus one for the calling thread.
+     * Code outside libavcodec should access this field using
+     * av_codec_{get,set}_executor(avctx)
+     * - encoding: Set by user before avcodec_open2(), must outlive the context.
+     * - decoding: Set by user before avcodec_open2(), must outlive the context.
+     */
+    AVExecutor *executor;
+
+    /**
+     * Priority of the slice jobs of this context in the executor, see
+     * av_executor_execute().
+     * - encoding: set by user through AVOptions (NO direct access)
+     * - decoding: set by user through AVOptions (NO direct access)
+     */
+    int executor_priority;
 } AVCodecContext;
 
 AVRational av_codec_get_pkt_timebase         (const AVCodecContext *avctx);
@@ -3151,6 +3173,9 @@ void av_codec_set_seek_preroll(AVCodecContext *avctx, int val);
 uint16_t *av_codec_get_chroma_intra_matrix(const AVCodecContext *avctx);
 void av_codec_set_chroma_intra_matrix(AVCodecContext *avctx, uint16_t *val);
 
+AVExecutor *av_codec_get_executor(const AVCodecContext *avctx);
+void        av_codec_set_executor(AVCodecContext *avctx, AVExecutor *val);
+
 /**
  * AVProfile.
  */
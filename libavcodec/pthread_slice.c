@@ -39,6 +39,7 @@
 
 #include "libavutil/common.h"
 #include "libavutil/cpu.h"
+#include "libavutil/executor.h"
 #include "libavutil/mem.h"
 
 typedef int (action_func)(AVCodecContext *c, void *arg);
@@ -109,6 +110,11 @@ void ff_slice_thread_free(AVCodecContext *avctx)
     SliceThreadContext *c = avctx->internal->thread_ctx;
     int i;
 
+    if (!c->workers) {
+        av_freep(&avctx->internal->thread_ctx);
+        return;
+    }
+
     pthread_mutex_lock(&c->current_job_lock);
     c->done = 1;
     pthread_cond_broadcast(&c->current_job_cond);
@@ -131,6 +137,15 @@ static av_always_inline void thread_park_workers(SliceThreadContext *c, int thre
     pthread_mutex_unlock(&c->current_job_lock);
 }
 
+static int executor_job(void *v, void *arg, int jobnr, int threadnr)
+{
+    AVCodecContext *avctx = v;
+    SliceThreadContext *c = avctx->internal->thread_ctx;
+
+    return c->func ? c->func(avctx, (char*)arg + jobnr*c->job_size):
+                     c->func2(avctx, arg, jobnr, threadnr);
+}
+
 static int thread_execute(AVCodecContext *avctx, action_func* func, void *arg, int *ret, int job_count, int job_size)
 {
     SliceThreadContext *c = avctx->internal->thread_ctx;
@@ -142,6 +157,14 @@ static int thread_execute(AVCodecContext *avctx, action_func* func, void *arg, i
     if (job_count <= 0)
         return 0;
 
+    if (avctx->executor) {
+        c->job_size = job_size;
+        c->func     = func;
+        return av_executor_execute(avctx->executor, executor_job, avctx, arg, ret,
+                                   job_count, avctx->thread_count,
+                                   avctx->executor_priority);
+    }
+
     pthread_mutex_lock(&c->current_job_lock);
 
     c->current_job = avctx->thread_count;
@@ -182,7 +205,8 @@ int ff_slice_thread_init(AVCodecContext *avctx)
 #endif
 
     if (!thread_count) {
-        int nb_cpus = av_cpu_count();
+        // the threads of a shared executor stand for the cores
+        int nb_cpus = avctx->executor ? av_executor_get_nb_threads(avctx->executor) : av_cpu_count();
         if  (avctx->height)
             nb_cpus = FFMIN(nb_cpus, (avctx->height+15)/16);
         // use number of cores + 1 as thread count if there is more than one
@@ -201,6 +225,13 @@ int ff_slice_thread_init(AVCodecContext *avctx)
     if (!c)
         return -1;
 
+    if (avctx->executor) {
+        avctx->internal->thread_ctx = c;
+        avctx->execute  = thread_execute;
+        avctx->execute2 = thread_execute2;
+        return 0;
+    }
+
     c->workers = av_mallocz_array(thread_count, sizeof(pthread_t));
     if (!c->workers) {
         av_free(c);
@@ -1275,6 +1275,7 @@ MAKE_ACCESSORS(AVCodecContext, codec, const AVCodecDescriptor *, codec_descripto
 MAKE_ACCESSORS(AVCodecContext, codec, int, lowres)
 MAKE_ACCESSORS(AVCodecContext, codec, int, seek_preroll)
 MAKE_ACCESSORS(AVCodecContext, codec, uint16_t*, chroma_intra_matrix)
+MAKE_ACCESSORS(AVCodecContext, codec, AVExecutor*, executor)
 
 int av_codec_get_max_lowres(const AVCodec *codec)
 {
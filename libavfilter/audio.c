@@ -71,7 +71,8 @@ AVFrame *ff_get_audio_buffer(AVFilterLink *link, int nb_samples)
 {
     AVFrame *ret = NULL;
 
-    if (link->dstpad->get_audio_buffer)
+    /* the destination of a pipelined link runs on another thread */
+    if (link->dstpad->get_audio_buffer && !link->pipe)
         ret = link->dstpad->get_audio_buffer(link, nb_samples);
 
     if (!ret)
@@ -35,7 +35,9 @@
 #include "audio.h"
 #include "avfilter.h"
 #include "formats.h"
+#include "framepool.h"
 #include "internal.h"
+#include "pipeline.h"
 
 #include "libavutil/ffversion.h"
 const char av_filter_ffversion[] = "FFmpeg version " FFMPEG_VERSION;
@@ -168,6 +170,7 @@ void avfilter_link_free(AVFilterLink **link)
         return;
 
     av_frame_free(&(*link)->partial_buf);
+    ff_video_frame_pool_uninit((FFVideoFramePool **)&(*link)->frame_pool);
 
     av_freep(link);
 }
@@ -350,7 +353,9 @@ int ff_request_frame(AVFilterLink *link)
     av_assert0(!link->frame_requested);
     link->frame_requested = 1;
     while (link->frame_requested) {
-        if (link->srcpad->request_frame)
+        if (link->pipe)
+            ret = ff_pipeline_request_frame(link);
+        else if (link->srcpad->request_frame)
             ret = link->srcpad->request_frame(link);
         else if (link->src->inputs[0])
             ret = ff_request_frame(link->src->inputs[0]);
@@ -375,6 +380,8 @@ int ff_poll_frame(AVFilterLink *link)
 {
     int i, min = INT_MAX;
 
+    if (link->pipe)
+        return ff_pipeline_poll_frame(link);
     if (link->srcpad->poll_frame)
         return link->srcpad->poll_frame(link);
 
@@ -704,6 +711,13 @@ static void free_link(AVFilterLink *link)
     if (!link)
         return;
 
+    if (link->frame_pool) {
+        FFVideoFramePool *pool = link->frame_pool;
+        av_log(link->dst, AV_LOG_VERBOSE,
+               "Frame pool of input link %s: %"PRId64" hits, %"PRId64" misses\n",
+               link->dstpad->name, pool->hits, pool->misses);
+    }
+
     if (link->src)
         link->src->outputs[link->srcpad - link->src->output_pads] = NULL;
     if (link->dst)
@@ -725,8 +739,10 @@ void avfilter_free(AVFilterContext *filter)
     if (!filter)
         return;
 
-    if (filter->graph)
+    if (filter->graph) {
+        ff_pipeline_uninit(filter->graph);
         ff_filter_graph_remove_filter(filter->graph, filter);
+    }
 
     if (filter->filter->uninit)
         filter->filter->uninit(filter);
@@ -1161,6 +1177,14 @@ int ff_filter_frame(AVFilterLink *link, AVFrame *frame)
         av_assert1(frame->sample_rate           == link->sample_rate);
     }
 
+    link->frame_count_in++;
+    if (link->pipe)
+        return ff_pipeline_filter_frame(link, frame);
+    return ff_filter_frame_deliver(link, frame);
+}
+
+int ff_filter_frame_deliver(AVFilterLink *link, AVFrame *frame)
+{
     /* Go directly to actual filtering if possible */
     if (link->type == AVMEDIA_TYPE_AUDIO &&
         link->min_samples &&
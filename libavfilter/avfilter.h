@@ -38,6 +38,7 @@
 #include "libavutil/attributes.h"
 #include "libavutil/avutil.h"
 #include "libavutil/dict.h"
+#include "libavutil/executor.h"
 #include "libavutil/frame.h"
 #include "libavutil/log.h"
 #include "libavutil/samplefmt.h"
@@ -627,6 +628,13 @@ typedef struct AVFilter {
  */
 #define AVFILTER_THREAD_SLICE (1 << 0)
 
+/**
+ * Run the filters of a graph on separate threads, passing frames between
+ * them through queues. Only meaningful in AVFilterGraph.thread_type, and off
+ * by default there.
+ */
+#define AVFILTER_THREAD_FRAME (1 << 1)
+
 typedef struct AVFilterInternal AVFilterInternal;
 
 /** An instance of a filter */
@@ -857,9 +865,32 @@ struct AVFilterLink {
     unsigned flags;
 
     /**
-     * Number of past frames sent through the link.
+     * Number of past frames sent through the link, counted when the
+     * destination filter has processed them.
      */
     int64_t frame_count;
+
+    /**
+     * Pool of frame buffers used by the default video buffer allocator.
+     * This should not be accessed directly by the filters.
+     */
+    void *frame_pool;
+
+    /**
+     * Number of past frames sent through the link, counted when the source
+     * filter sends them. Source filters numbering their output should use
+     * this one, it does not depend on when the destination gets to them.
+     * With AVFILTER_THREAD_FRAME, it runs ahead of frame_count while frames
+     * are queued for a destination running on another thread.
+     */
+    int64_t frame_count_in;
+
+    /**
+     * Queue of frames when the two ends of the link run on different
+     * threads, see AVFILTER_THREAD_FRAME.
+     * This should not be accessed directly by the filters.
+     */
+    void *pipe;
 };
 
 /**
@@ -1230,6 +1261,23 @@ typedef struct AVFilterGraph {
 
     char *aresample_swr_opts; ///< swr options to use for the auto-inserted aresample filters, Access ONLY through AVOptions
 
+    /**
+     * Shared thread pool to run the slice threads of the filters on, instead
+     * of threads owned by this graph. May be set by the caller before adding
+     * any filters to the graph, and must outlive the graph.
+     *
+     * The number of threads used by each execute is then still limited by
+     * nb_threads, which defaults to the number of threads of the pool plus
+     * one for the calling thread.
+     */
+    AVExecutor *executor;
+
+    /**
+     * Priority of the slice jobs of this graph in the executor, see
+     * av_executor_execute(). Access ONLY through AVOptions.
+     */
+    int executor_priority;
+
     /**
      * Private fields
      *
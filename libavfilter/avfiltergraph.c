@@ -35,6 +35,7 @@
 #include "avfilter.h"
 #include "formats.h"
 #include "internal.h"
+#include "pipeline.h"
 #include "thread.h"
 
 #define OFFSET(x) offsetof(AVFilterGraph, x)
@@ -43,12 +44,15 @@ static const AVOption filtergraph_options[] = {
     { "thread_type", "Allowed thread types", OFFSET(thread_type), AV_OPT_TYPE_FLAGS,
         { .i64 = AVFILTER_THREAD_SLICE }, 0, INT_MAX, FLAGS, "thread_type" },
         { "slice", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_SLICE }, .flags = FLAGS, .unit = "thread_type" },
+        { "frame", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_FRAME }, .flags = FLAGS, .unit = "thread_type" },
     { "threads",     "Maximum number of threads", OFFSET(nb_threads),
         AV_OPT_TYPE_INT,   { .i64 = 0 }, 0, INT_MAX, FLAGS },
     {"scale_sws_opts"       , "default scale filter options"        , OFFSET(scale_sws_opts)        ,
         AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, FLAGS },
     {"aresample_swr_opts"   , "default aresample filter options"    , OFFSET(aresample_swr_opts)    ,
         AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, FLAGS },
+    { "executor_priority", "Priority of the slice jobs in the shared executor", OFFSET(executor_priority),
+        AV_OPT_TYPE_INT,   { .i64 = 0 }, INT_MIN, INT_MAX, FLAGS },
     { NULL },
 };
 
@@ -67,7 +71,7 @@ void ff_graph_thread_free(AVFilterGraph *graph)
 
 int ff_graph_thread_init(AVFilterGraph *graph)
 {
-    graph->thread_type = 0;
+    graph->thread_type &= ~AVFILTER_THREAD_SLICE;
     graph->nb_threads  = 1;
     return 0;
 }
@@ -109,6 +113,8 @@ void avfilter_graph_free(AVFilterGraph **graph)
     if (!*graph)
         return;
 
+    ff_pipeline_uninit(*graph);
+
     while ((*graph)->nb_filters)
         avfilter_free((*graph)->filters[0]);
 
@@ -181,7 +187,8 @@ AVFilterContext *avfilter_graph_alloc_filter(AVFilterGraph *graph,
 {
     AVFilterContext **filters, *s;
 
-    if (graph->thread_type && !graph->internal->thread_execute) {
+    if (graph->thread_type & AVFILTER_THREAD_SLICE &&
+        !graph->internal->thread_execute) {
         if (graph->execute) {
             graph->internal->thread_execute = graph->execute;
         } else {
@@ -1203,6 +1210,8 @@ int avfilter_graph_config(AVFilterGraph *graphctx, void *log_ctx)
 {
     int ret;
 
+    ff_pipeline_uninit(graphctx);
+
     if ((ret = graph_check_validity(graphctx, log_ctx)))
         return ret;
     if ((ret = graph_insert_fifos(graphctx, log_ctx)) < 0)
@@ -1214,11 +1223,28 @@ int avfilter_graph_config(AVFilterGraph *graphctx, void *log_ctx)
     if ((ret = ff_avfilter_graph_config_pointers(graphctx, log_ctx)))
         return ret;
 
+    if (graphctx->thread_type & AVFILTER_THREAD_FRAME &&
+        (ret = ff_pipeline_init(graphctx)) < 0)
+        return ret;
+
     return 0;
 }
 
+typedef struct SendCommandArgs {
+    const char *cmd, *arg;
+    char *res;
+    int res_len, flags;
+} SendCommandArgs;
+
+static int send_command(AVFilterContext *filter, void *opaque)
+{
+    SendCommandArgs *a = opaque;
+    return avfilter_process_command(filter, a->cmd, a->arg, a->res, a->res_len, a->flags);
+}
+
 int avfilter_graph_send_command(AVFilterGraph *graph, const char *target, const char *cmd, const char *arg, char *res, int res_len, int flags)
 {
+    SendCommandArgs args = { cmd, arg, res, res_len, flags };
     int i, r = AVERROR(ENOSYS);
 
     if (!graph)
@@ -1236,7 +1262,7 @@ int avfilter_graph_send_command(AVFilterGraph *graph, const char *target, const
     for (i = 0; i < graph->nb_filters; i++) {
         AVFilterContext *filter = graph->filters[i];
         if (!strcmp(target, "all") || (filter->name && !strcmp(target, filter->name)) || !strcmp(target, filter->filter->name)) {
-            r = avfilter_process_command(filter, cmd, arg, res, res_len, flags);
+            r = ff_pipeline_call(filter, send_command, &args);
             if (r != AVERROR(ENOSYS)) {
                 if ((flags & AVFILTER_CMD_FLAG_ONE) || r < 0)
                     return r;
@@ -1247,8 +1273,31 @@ int avfilter_graph_send_command(AVFilterGraph *graph, const char *target, const
     return r;
 }
 
+typedef struct QueueCommandArgs {
+    const char *command, *arg;
+    int flags;
+    double ts;
+} QueueCommandArgs;
+
+static int queue_command(AVFilterContext *filter, void *opaque)
+{
+    QueueCommandArgs *a = opaque;
+    AVFilterCommand **queue = &filter->command_queue, *next;
+    while (*queue && (*queue)->time <= a->ts)
+        queue = &(*queue)->next;
+    next = *queue;
+    *queue = av_mallocz(sizeof(AVFilterCommand));
+    (*queue)->command = av_strdup(a->command);
+    (*queue)->arg     = av_strdup(a->arg);
+    (*queue)->time    = a->ts;
+    (*queue)->flags   = a->flags;
+    (*queue)->next    = next;
+    return 0;
+}
+
 int avfilter_graph_queue_command(AVFilterGraph *graph, const char *target, const char *command, const char *arg, int flags, double ts)
 {
+    QueueCommandArgs args = { command, arg, flags, ts };
     int i;
 
     if(!graph)
@@ -1257,16 +1306,7 @@ int avfilter_graph_queue_command(AVFilterGraph *graph, const char *target, const
     for (i = 0; i < graph->nb_filters; i++) {
         AVFilterContext *filter = graph->filters[i];
         if(filter && (!strcmp(target, "all") || !strcmp(target, filter->name) || !strcmp(target, filter->filter->name))){
-            AVFilterCommand **queue = &filter->command_queue, *next;
-            while (*queue && (*queue)->time <= ts)
-                queue = &(*queue)->next;
-            next = *queue;
-            *queue = av_mallocz(sizeof(AVFilterCommand));
-            (*queue)->command = av_strdup(command);
-            (*queue)->arg     = av_strdup(arg);
-            (*queue)->time    = ts;
-            (*queue)->flags   = flags;
-            (*queue)->next    = next;
+            ff_pipeline_call(filter, queue_command, &args);
             if(flags & AVFILTER_CMD_FLAG_ONE)
                 return 0;
         }
@@ -35,6 +35,7 @@
 #include "avfilter.h"
 #include "buffersink.h"
 #include "internal.h"
+#include "pipeline.h"
 
 typedef struct BufferSinkContext {
     const AVClass *class;
@@ -130,6 +131,14 @@ int attribute_align_arg av_buffersink_get_frame_flags(AVFilterContext *ctx, AVFr
     int ret;
     AVFrame *cur_frame;
 
+    /* take the frames the pipeline threads have already produced */
+    if (!av_fifo_size(buf->fifo)) {
+        if (flags & AV_BUFFERSINK_FLAG_DRAIN)
+            ff_pipeline_drain(ctx->graph);
+        else
+            ff_pipeline_deliver(inlink);
+    }
+
     /* no picref available, fetch it from the filterchain */
     if (!av_fifo_size(buf->fifo)) {
         if (flags & AV_BUFFERSINK_FLAG_NO_REQUEST)
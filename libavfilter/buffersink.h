@@ -116,6 +116,14 @@ int av_buffersink_get_frame_flags(AVFilterContext *ctx, AVFrame *frame, int flag
  */
 #define AV_BUFFERSINK_FLAG_NO_REQUEST 2
 
+/**
+ * Tell av_buffersink_get_frame_flags() to wait, when no frame is buffered,
+ * until the filters running on other threads with AVFILTER_THREAD_FRAME have
+ * processed all the frames sent to the buffer sources of the graph. The
+ * frames available are then the same as without AVFILTER_THREAD_FRAME.
+ */
+#define AV_BUFFERSINK_FLAG_DRAIN 4
+
 /**
  * Struct to use for initializing a buffersink context.
  */
@@ -0,0 +1,169 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/common.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/mem.h"
+#include "libavutil/pixdesc.h"
+
+#include "framepool.h"
+
+static AVBufferRef *pool_alloc_buffer(void *opaque, int size)
+{
+    FFVideoFramePool *pool = opaque;
+
+    pool->nb_allocated++;
+    return av_buffer_alloc(size);
+}
+
+static void pool_reset(FFVideoFramePool *pool)
+{
+    int i;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(pool->pools); i++)
+        av_buffer_pool_uninit(&pool->pools[i]);
+    memset(pool->linesize, 0, sizeof(pool->linesize));
+    pool->width  = 0;
+    pool->height = 0;
+    pool->format = AV_PIX_FMT_NONE;
+}
+
+/* Same layout as av_frame_get_buffer(), so that pooled frames are
+ * interchangeable with directly allocated ones. */
+static int pool_configure(FFVideoFramePool *pool, int w, int h,
+                          enum AVPixelFormat format)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    int i, ret;
+
+    pool_reset(pool);
+
+    if (!desc)
+        return AVERROR(EINVAL);
+    if ((ret = av_image_check_size(w, h, 0, NULL)) < 0)
+        return ret;
+
+    for (i = 1; i <= pool->align; i += i) {
+        ret = av_image_fill_linesizes(pool->linesize, format, FFALIGN(w, i));
+        if (ret < 0)
+            return ret;
+        if (!(pool->linesize[0] & (pool->align - 1)))
+            break;
+    }
+
+    for (i = 0; i < 4 && pool->linesize[i]; i++) {
+        int plane_h = FFALIGN(h, 32);
+        if (i == 1 || i == 2)
+            plane_h = FF_CEIL_RSHIFT(plane_h, desc->log2_chroma_h);
+
+        pool->linesize[i] = FFALIGN(pool->linesize[i], pool->align);
+        pool->pools[i] = av_buffer_pool_init2(pool->linesize[i] * plane_h + 16 + 16/*STRIDE_ALIGN*/ - 1,
+                                              pool, pool_alloc_buffer, NULL);
+        if (!pool->pools[i])
+            goto fail;
+    }
+    if (desc->flags & AV_PIX_FMT_FLAG_PAL || desc->flags & AV_PIX_FMT_FLAG_PSEUDOPAL) {
+        av_buffer_pool_uninit(&pool->pools[1]);
+        pool->pools[1] = av_buffer_pool_init2(1024, pool, pool_alloc_buffer, NULL);
+        if (!pool->pools[1])
+            goto fail;
+    }
+
+    pool->width  = w;
+    pool->height = h;
+    pool->format = format;
+    return 0;
+fail:
+    pool_reset(pool);
+    return AVERROR(ENOMEM);
+}
+
+FFVideoFramePool *ff_video_frame_pool_alloc(int align)
+{
+    FFVideoFramePool *pool = av_mallocz(sizeof(*pool));
+
+    if (!pool)
+        return NULL;
+    if (ff_mutex_init(&pool->lock, NULL)) {
+        av_freep(&pool);
+        return NULL;
+    }
+    pool->align  = align;
+    pool->format = AV_PIX_FMT_NONE;
+    return pool;
+}
+
+static AVFrame *pool_get(FFVideoFramePool *pool, int w, int h,
+                         enum AVPixelFormat format)
+{
+    AVFrame *frame;
+    int nb_allocated = pool->nb_allocated;
+    int i;
+
+    if (w != pool->width || h != pool->height || format != pool->format) {
+        if (pool_configure(pool, w, h, format) < 0)
+            return NULL;
+    }
+
+    frame = av_frame_alloc();
+    if (!frame)
+        return NULL;
+
+    frame->width  = w;
+    frame->height = h;
+    frame->format = format;
+
+    for (i = 0; i < 4 && pool->pools[i]; i++) {
+        frame->buf[i] = av_buffer_pool_get(pool->pools[i]);
+        if (!frame->buf[i]) {
+            av_frame_free(&frame);
+            return NULL;
+        }
+        frame->data[i]     = frame->buf[i]->data;
+        frame->linesize[i] = pool->linesize[i];
+    }
+    frame->extended_data = frame->data;
+
+    if (pool->nb_allocated != nb_allocated)
+        pool->misses++;
+    else
+        pool->hits++;
+
+    return frame;
+}
+
+AVFrame *ff_video_frame_pool_get(FFVideoFramePool *pool, int w, int h,
+                                 enum AVPixelFormat format)
+{
+    AVFrame *frame;
+
+    ff_mutex_lock(&pool->lock);
+    frame = pool_get(pool, w, h, format);
+    ff_mutex_unlock(&pool->lock);
+
+    return frame;
+}
+
+void ff_video_frame_pool_uninit(FFVideoFramePool **pool)
+{
+    if (!*pool)
+        return;
+    pool_reset(*pool);
+    ff_mutex_destroy(&(*pool)->lock);
+    av_freep(pool);
+}
@@ -0,0 +1,88 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_FRAMEPOOL_H
+#define AVFILTER_FRAMEPOOL_H
+
+#include <stdint.h>
+
+#include "libavutil/buffer.h"
+#include "libavutil/frame.h"
+#include "libavutil/pixfmt.h"
+#include "libavutil/thread.h"
+
+/**
+ * Pool of video frame buffers.
+ *
+ * Frames returned by ff_video_frame_pool_get() are backed by AVBufferPools,
+ * so that freeing a frame returns its planes to the pool instead of the heap.
+ * The pools are keyed on width, height and pixel format and are rebuilt
+ * whenever a frame with different properties is requested.
+ *
+ * ff_video_frame_pool_get() may be called from several threads, as happens
+ * for the input link of a pipelined filter which allocates frames on it
+ * itself. The frames it returns may be freed from any thread.
+ */
+typedef struct FFVideoFramePool {
+    int width;
+    int height;
+    enum AVPixelFormat format;
+    int align;
+    int linesize[4];
+    AVBufferPool *pools[4];
+    AVMutex lock;
+
+    /**
+     * Number of buffers allocated from the heap, updated by the pool
+     * allocator.
+     */
+    int nb_allocated;
+
+    /**
+     * Number of frames served entirely from recycled buffers (hits) and
+     * number of frames which needed at least one new buffer (misses).
+     * Both persist across rebuilds.
+     */
+    int64_t hits;
+    int64_t misses;
+} FFVideoFramePool;
+
+/**
+ * Allocate an empty frame pool.
+ *
+ * @param align the linesize alignment of the returned frames
+ * @return the pool on success, NULL on allocation failure
+ */
+FFVideoFramePool *ff_video_frame_pool_alloc(int align);
+
+/**
+ * Get a frame from the pool, rebuilding it if the requested properties
+ * differ from the ones of the previous frame.
+ *
+ * @return a frame with allocated planes on success, NULL on error
+ */
+AVFrame *ff_video_frame_pool_get(FFVideoFramePool *pool, int w, int h,
+                                 enum AVPixelFormat format);
+
+/**
+ * Free the pool and set *pool to NULL. Frames still in use remain valid and
+ * the underlying buffers are freed once all of them are released.
+ */
+void ff_video_frame_pool_uninit(FFVideoFramePool **pool);
+
+#endif /* AVFILTER_FRAMEPOOL_H */
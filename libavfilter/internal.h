@@ -156,10 +156,12 @@ struct AVFilterPad {
 struct AVFilterGraphInternal {
     void *thread;
     avfilter_execute_func *thread_execute;
+    struct Pipeline *pipeline;
 };
 
 struct AVFilterInternal {
     avfilter_execute_func *execute;
+    struct PipelineStage *pipeline_stage;
 };
 
 #if FF_API_AVFILTERBUFFER
@@ -346,6 +348,12 @@ int ff_buffersink_read_samples_compat(AVFilterContext *ctx, AVFilterBufferRef **
  */
 int ff_filter_frame(AVFilterLink *link, AVFrame *frame);
 
+/**
+ * Pass a frame to the destination of the link, without going through its
+ * pipeline queue. Same semantics as ff_filter_frame() otherwise.
+ */
+int ff_filter_frame_deliver(AVFilterLink *link, AVFrame *frame);
+
 /**
  * Flags for AVFilterLink.flags.
  */
@@ -0,0 +1,853 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Libavfilter frame-level pipelining
+ *
+ * Each pipelined filter owns a thread which delivers the frames queued on
+ * its input and, when its output queue has room and the destination asked
+ * for frames, calls its request_frame(). Filters allocating the frames of
+ * their input share the thread of the filter feeding them instead. Only
+ * chains of filters starting at a buffer source or at a source filter are
+ * pipelined, so that the only
+ * filters the pipeline threads need from the caller's thread are buffer
+ * sources. A caller waiting for a frame serves their requests, but runs no
+ * other filter code, so the filters on its thread are never reentered in
+ * ways a single-threaded graph would not do. A caller waiting to queue a
+ * frame passes the frames of full queues on to the filters on its thread,
+ * as a single-threaded graph would have done during the same call.
+ *
+ * All the queues and flags are protected by a single mutex, which is never
+ * held while filter code runs.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "libavutil/fifo.h"
+#include "libavutil/frame.h"
+#include "libavutil/mem.h"
+
+#include "audio.h"
+#include "avfilter.h"
+#include "framepool.h"
+#include "internal.h"
+#include "pipeline.h"
+#include "video.h"
+
+#if HAVE_PTHREADS
+
+#include <pthread.h>
+
+/* Number of frames a pipeline thread may produce ahead of its destination. */
+#define PIPE_QUEUE_SIZE 4
+
+typedef struct Pipeline Pipeline;
+typedef struct PipelineStage PipelineStage;
+
+typedef struct PipelineCall {
+    AVFilterContext *ctx;
+    int (*func)(AVFilterContext *ctx, void *arg);
+    void *arg;
+    int ret;
+    int done;
+    PipelineStage *caller;
+    struct PipelineCall *next;
+} PipelineCall;
+
+typedef struct Pipe {
+    AVFilterLink *link;
+    PipelineStage *src;
+    PipelineStage *dst;
+    AVFifoBuffer *fifo;     ///< queued AVFrame pointers, at most PIPE_QUEUE_SIZE
+    int want;               ///< the destination asked for frames
+    int eagain;             ///< the source answered the last request with EAGAIN
+    int status;             ///< final status of the source, after the queued frames
+    int dst_status;         ///< error returned by the destination
+    int serving;            ///< the source is being asked for frames
+    int requested;          ///< the caller waits for a frame from this pipe
+    int eof_held;           ///< the buffer source is at EOF, see pipe_serve()
+    unsigned nb_pushed;     ///< only accessed by the source thread
+} Pipe;
+
+struct PipelineStage {
+    Pipeline *p;
+    AVFilterContext *filter; ///< first filter of the stage, NULL for the caller's
+    Pipe *in;
+    Pipe *out;
+    pthread_t thread;
+    pthread_cond_t cond;
+    PipelineCall *calls;
+    int waiting;            ///< the thread is idle, waiting for work
+};
+
+struct Pipeline {
+    pthread_mutex_t lock;
+    PipelineStage *stages;  ///< the caller's stage first
+    int nb_stages;
+    int nb_threads;
+    Pipe *pipes;
+    int nb_pipes;
+    int quit;
+    int draining;           ///< the caller waits in ff_pipeline_drain()
+};
+
+static int is_buffersrc(AVFilterContext *ctx)
+{
+    return !strcmp(ctx->filter->name, "buffer") ||
+           !strcmp(ctx->filter->name, "abuffer");
+}
+
+static int is_pipelined(AVFilterContext *ctx)
+{
+    /* buffer sources are fed by the caller, keep them on its thread */
+    if (is_buffersrc(ctx))
+        return 0;
+
+    for (;;) {
+        if (ctx->nb_outputs != 1 || ctx->nb_inputs > 1)
+            return 0;
+        if (!ctx->nb_inputs)
+            return 1;
+        ctx = ctx->inputs[0]->src;
+        if (is_buffersrc(ctx))
+            return 1;
+    }
+}
+
+/**
+ * Check whether the frames sent on link are allocated by the code of its
+ * destination, directly or through pass-through filters. vflip for instance
+ * hands out buffers with negative strides. Such an allocator runs on the
+ * thread of the source, so both ends of the link have to share it.
+ */
+static int link_dst_allocates(AVFilterLink *link)
+{
+    for (;;) {
+        if (link->type == AVMEDIA_TYPE_VIDEO) {
+            if (!link->dstpad->get_video_buffer)
+                return 0;
+            if (link->dstpad->get_video_buffer != ff_null_get_video_buffer)
+                return 1;
+        } else if (link->type == AVMEDIA_TYPE_AUDIO) {
+            if (!link->dstpad->get_audio_buffer)
+                return 0;
+            if (link->dstpad->get_audio_buffer != ff_null_get_audio_buffer)
+                return 1;
+        } else {
+            return 0;
+        }
+        link = link->dst->outputs[0];
+    }
+}
+
+static int filter_index(AVFilterGraph *graph, AVFilterContext *ctx)
+{
+    int i;
+
+    for (i = 0; i < graph->nb_filters; i++)
+        if (graph->filters[i] == ctx)
+            return i;
+    return -1;
+}
+
+/**
+ * Give each filter of graph the number of the stage running it, 0 for the
+ * caller's thread. The filters of a stage form a contiguous part of a chain.
+ * @return the number of stages
+ */
+static int assign_stages(AVFilterGraph *graph, int *stage_of)
+{
+    int i, j, k, changed, nb_stages = 1;
+
+    for (i = 0; i < graph->nb_filters; i++)
+        stage_of[i] = is_pipelined(graph->filters[i]) ? i + 1 : 0;
+
+    /* merge the ends of the links whose destination allocates the frames,
+     * into the caller's stage when the destination runs there */
+    do {
+        changed = 0;
+        for (i = 0; i < graph->nb_filters; i++) {
+            AVFilterContext *ctx = graph->filters[i];
+
+            for (j = 0; j < ctx->nb_outputs; j++) {
+                AVFilterLink *link = ctx->outputs[j];
+                int dst, from, to;
+
+                if (!link || (dst = filter_index(graph, link->dst)) < 0 ||
+                    stage_of[i] == stage_of[dst] || !link_dst_allocates(link))
+                    continue;
+                from = stage_of[dst] ? stage_of[dst] : stage_of[i];
+                to   = stage_of[dst] ? stage_of[i]   : 0;
+                for (k = 0; k < graph->nb_filters; k++)
+                    if (stage_of[k] == from)
+                        stage_of[k] = to;
+                changed = 1;
+            }
+        }
+    } while (changed);
+
+    /* number the remaining stages from 1, negated until all are done */
+    for (i = 0; i < graph->nb_filters; i++) {
+        int old = stage_of[i];
+
+        if (old <= 0)
+            continue;
+        for (k = i; k < graph->nb_filters; k++)
+            if (stage_of[k] == old)
+                stage_of[k] = -nb_stages;
+        nb_stages++;
+    }
+    for (i = 0; i < graph->nb_filters; i++)
+        stage_of[i] = -stage_of[i];
+
+    return nb_stages;
+}
+
+static int pipe_full(Pipe *pipe)
+{
+    return av_fifo_size(pipe->fifo) >= PIPE_QUEUE_SIZE * sizeof(AVFrame *);
+}
+
+static int pipe_can_serve(Pipe *pipe)
+{
+    return pipe->want && !pipe_full(pipe) && !pipe->status && !pipe->dst_status;
+}
+
+/* The functions below are called with the lock held. Those running filter
+ * code release it meanwhile. */
+
+static AVFrame *pipe_pop(Pipe *pipe)
+{
+    AVFrame *frame;
+
+    av_fifo_generic_read(pipe->fifo, &frame, sizeof(frame), NULL);
+    pipe->eagain = 0;
+    pthread_cond_signal(&pipe->src->cond);
+    return frame;
+}
+
+static int pipe_deliver(Pipe *pipe, AVFrame *frame)
+{
+    Pipeline *p = pipe->dst->p;
+    int ret;
+
+    pthread_mutex_unlock(&p->lock);
+    ret = ff_filter_frame_deliver(pipe->link, frame);
+    pthread_mutex_lock(&p->lock);
+
+    if (ret < 0 && !pipe->dst_status) {
+        pipe->dst_status = ret;
+        pthread_cond_signal(&pipe->src->cond);
+    }
+    return ret;
+}
+
+/* Check whether the caller waits for the output of the chain fed by pipe. */
+static int chain_requested(Pipe *pipe)
+{
+    PipelineStage *caller = &pipe->src->p->stages[0];
+
+    while (pipe->dst != caller) {
+        pipe = pipe->dst->out;
+        if (!pipe)
+            return 0;
+    }
+    return pipe->requested;
+}
+
+/* The pipe from the buffer source at the start of the chain feeding pipe,
+ * NULL if the chain starts at a source filter. */
+static Pipe *chain_input(Pipe *pipe)
+{
+    PipelineStage *caller = &pipe->src->p->stages[0];
+
+    while (pipe->src != caller) {
+        pipe = pipe->src->in;
+        if (!pipe)
+            return NULL;
+    }
+    return pipe;
+}
+
+/* Same loop as ff_request_frame(), on the source side of the pipe. The
+ * framing of audio frames is done by the destination, so the source loops
+ * until it has queued a frame.
+ * A single-threaded graph only sees the EOF of a buffer source when its
+ * output is requested, and the filters flush their last frames then. Reading
+ * ahead must not flush them earlier, so the EOF is held back as EAGAIN until
+ * the caller asks for the output of the chain. */
+static int pipe_serve(Pipe *pipe)
+{
+    Pipeline *p = pipe->src->p;
+    AVFilterLink *link = pipe->link;
+    unsigned nb_pushed = pipe->nb_pushed;
+    int wanted = pipe->want;
+    int ret = -1;
+
+    pipe->serving = 1;
+    pthread_mutex_unlock(&p->lock);
+    do {
+        if (link->srcpad->request_frame)
+            ret = link->srcpad->request_frame(link);
+        else if (link->src->inputs[0])
+            ret = ff_request_frame(link->src->inputs[0]);
+    } while (ret >= 0 && pipe->nb_pushed == nb_pushed);
+    pthread_mutex_lock(&p->lock);
+    pipe->serving = 0;
+
+    pipe->eof_held = 0;
+    if (ret == AVERROR_EOF && pipe->src == &p->stages[0] && !chain_requested(pipe)) {
+        pipe->eof_held = 1;
+        ret = AVERROR(EAGAIN);
+    }
+    if (ret == AVERROR(EAGAIN)) {
+        pipe->want   = 0;
+        pipe->eagain = wanted;
+    } else if (ret < 0) {
+        pipe->want = 0;
+        if (!pipe->status)
+            pipe->status = ret;
+    }
+    pthread_cond_signal(&pipe->dst->cond);
+    return ret;
+}
+
+static int stage_run_call(PipelineStage *s)
+{
+    PipelineCall *call = s->calls;
+
+    if (!call)
+        return 0;
+    s->calls = call->next;
+
+    pthread_mutex_unlock(&s->p->lock);
+    call->ret = call->func(call->ctx, call->arg);
+    pthread_mutex_lock(&s->p->lock);
+
+    call->done = 1;
+    pthread_cond_signal(&call->caller->cond);
+    return 1;
+}
+
+/* Work done by the caller's thread for the pipeline threads while it waits.
+ * Frames queued for the filters on the caller's thread are left in their
+ * queues until those filters ask for them. Returns 1 if something was done. */
+static int caller_work(Pipeline *p)
+{
+    PipelineStage *caller = &p->stages[0];
+    int i;
+
+    if (stage_run_call(caller))
+        return 1;
+
+    for (i = 0; i < p->nb_pipes; i++) {
+        Pipe *pipe = &p->pipes[i];
+
+        if (pipe->src == caller && pipe_can_serve(pipe) && !pipe->serving) {
+            pipe_serve(pipe);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Pass a frame of a full queue feeding the caller's thread on to its
+ * destination, so that the pipeline thread blocked on that queue can go on.
+ * Only done while the caller waits to queue a frame itself. Returns 1 if a
+ * frame was passed. */
+static int caller_drain(Pipeline *p)
+{
+    PipelineStage *caller = &p->stages[0];
+    int i;
+
+    for (i = 0; i < p->nb_pipes; i++) {
+        Pipe *pipe = &p->pipes[i];
+
+        if (pipe->dst == caller && pipe_full(pipe)) {
+            pipe_deliver(pipe, pipe_pop(pipe));
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int stage_work(PipelineStage *s)
+{
+    return s->filter ? stage_run_call(s) : caller_work(s->p);
+}
+
+/**
+ * Check whether a request from the caller's thread on pipe can only be
+ * answered by more input from the caller. The chain of pipelined filters
+ * feeding the pipe is followed up to its buffer source, which is asked
+ * directly. This lets the caller feed more frames while the
+ * previous ones are still being processed, instead of waiting for them.
+ */
+static int pipe_starved(Pipe *pipe)
+{
+    Pipeline *p = pipe->dst->p;
+    PipelineStage *caller = &p->stages[0];
+    PipelineStage *s = pipe->src;
+
+    if (pipe->dst != caller)
+        return 0;
+
+    while (s != caller) {
+        if (!s->in)
+            return 0; /* source filter */
+        pipe = s->in;
+        if (av_fifo_size(pipe->fifo) || pipe->status)
+            return 0;
+        s = pipe->src;
+    }
+    if (pipe->dst_status || pipe->serving)
+        return 0;
+
+    return pipe_serve(pipe) == AVERROR(EAGAIN);
+}
+
+int ff_pipeline_filter_frame(AVFilterLink *link, AVFrame *frame)
+{
+    Pipe *pipe = link->pipe;
+    PipelineStage *s = pipe->src;
+    Pipeline *p = s->p;
+    int ret;
+
+    pthread_mutex_lock(&p->lock);
+    while (pipe_full(pipe) && !pipe->dst_status && !p->quit) {
+        if (stage_run_call(s))
+            continue;
+        if (!s->filter && caller_drain(p))
+            continue;
+        pthread_cond_wait(&s->cond, &p->lock);
+    }
+
+    ret = p->quit ? AVERROR_EXIT : pipe->dst_status;
+    if (ret >= 0) {
+        av_fifo_generic_write(pipe->fifo, &frame, sizeof(frame), NULL);
+        pipe->nb_pushed++;
+        pthread_cond_signal(&pipe->dst->cond);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    if (ret < 0)
+        av_frame_free(&frame);
+    return ret;
+}
+
+int ff_pipeline_request_frame(AVFilterLink *link)
+{
+    Pipe *pipe = link->pipe;
+    PipelineStage *s = pipe->dst;
+    Pipeline *p = s->p;
+    int ret;
+
+    pthread_mutex_lock(&p->lock);
+    if (s == &p->stages[0]) {
+        Pipe *in = chain_input(pipe);
+
+        pipe->requested = 1;
+        /* an EAGAIN caused by a held back EOF does not need more input */
+        if (in && in->eof_held)
+            pipe->eagain = 0;
+    }
+    for (;;) {
+        if (p->quit) {
+            ret = AVERROR_EXIT;
+            break;
+        }
+        if (av_fifo_size(pipe->fifo)) {
+            ret = pipe_deliver(pipe, pipe_pop(pipe));
+            break;
+        }
+        if (pipe->status) {
+            ret = pipe->status;
+            break;
+        }
+        if (pipe->eagain || pipe_starved(pipe)) {
+            pipe->eagain = 0;
+            ret = AVERROR(EAGAIN);
+            break;
+        }
+        if (!pipe->want) {
+            pipe->want = 1;
+            pthread_cond_signal(&pipe->src->cond);
+        }
+        if (!stage_work(s))
+            pthread_cond_wait(&s->cond, &p->lock);
+    }
+    pipe->requested = 0;
+    pthread_mutex_unlock(&p->lock);
+
+    return ret;
+}
+
+int ff_pipeline_poll_frame(AVFilterLink *link)
+{
+    Pipe *pipe = link->pipe;
+    Pipeline *p = pipe->dst->p;
+    int ret;
+
+    pthread_mutex_lock(&p->lock);
+    ret = av_fifo_size(pipe->fifo) / sizeof(AVFrame *);
+    pthread_mutex_unlock(&p->lock);
+
+    return ret;
+}
+
+static int stage_idle(PipelineStage *s)
+{
+    return s->waiting && !s->calls &&
+           !(s->in  && av_fifo_size(s->in->fifo)) &&
+           !(s->out && pipe_can_serve(s->out));
+}
+
+void ff_pipeline_drain(AVFilterGraph *graph)
+{
+    Pipeline *p = graph->internal->pipeline;
+    PipelineStage *caller;
+    int i, busy;
+
+    if (!p)
+        return;
+    caller = &p->stages[0];
+
+    pthread_mutex_lock(&p->lock);
+    p->draining = 1;
+    while (!p->quit) {
+        if (caller_work(p))
+            continue;
+
+        busy = 0;
+        for (i = 0; i < p->nb_pipes && !busy; i++) {
+            Pipe *pipe = &p->pipes[i];
+
+            if (pipe->dst == caller && av_fifo_size(pipe->fifo) && chain_input(pipe)) {
+                pipe_deliver(pipe, pipe_pop(pipe));
+                busy = 1;
+            }
+        }
+        if (busy)
+            continue;
+
+        /* chains starting at source filters never run dry */
+        for (i = 1; i < p->nb_stages && !busy; i++) {
+            PipelineStage *s = &p->stages[i];
+            busy = s->in && chain_input(s->in) && !stage_idle(s);
+        }
+        if (!busy)
+            break;
+        pthread_cond_wait(&caller->cond, &p->lock);
+    }
+    p->draining = 0;
+    pthread_mutex_unlock(&p->lock);
+}
+
+void ff_pipeline_deliver(AVFilterLink *link)
+{
+    Pipe *pipe = link->pipe;
+    Pipeline *p;
+
+    if (!pipe)
+        return;
+    p = pipe->dst->p;
+
+    pthread_mutex_lock(&p->lock);
+    while (av_fifo_size(pipe->fifo) && !p->quit)
+        pipe_deliver(pipe, pipe_pop(pipe));
+    pthread_mutex_unlock(&p->lock);
+}
+
+static PipelineStage *current_stage(Pipeline *p)
+{
+    pthread_t self = pthread_self();
+    int i;
+
+    for (i = 1; i < p->nb_threads + 1; i++)
+        if (pthread_equal(self, p->stages[i].thread))
+            return &p->stages[i];
+    return &p->stages[0];
+}
+
+int ff_pipeline_call(AVFilterContext *ctx,
+                     int (*func)(AVFilterContext *ctx, void *arg), void *arg)
+{
+    Pipeline *p = ctx->graph ? ctx->graph->internal->pipeline : NULL;
+    PipelineStage *owner, *self;
+    PipelineCall call = { 0 }, **last;
+
+    owner = ctx->internal->pipeline_stage;
+    if (!p || !owner)
+        return func(ctx, arg);
+
+    pthread_mutex_lock(&p->lock);
+    self = current_stage(p);
+    if (owner == self) {
+        pthread_mutex_unlock(&p->lock);
+        return func(ctx, arg);
+    }
+
+    call.ctx    = ctx;
+    call.func   = func;
+    call.arg    = arg;
+    call.caller = self;
+
+    for (last = &owner->calls; *last; last = &(*last)->next)
+        ;
+    *last = &call;
+    pthread_cond_signal(&owner->cond);
+
+    while (!call.done && !p->quit) {
+        if (!stage_work(self))
+            pthread_cond_wait(&self->cond, &p->lock);
+    }
+    if (!call.done) {
+        for (last = &owner->calls; *last != &call; last = &(*last)->next)
+            ;
+        *last = call.next;
+        call.ret = AVERROR_EXIT;
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return call.ret;
+}
+
+static void *attribute_align_arg worker(void *arg)
+{
+    PipelineStage *s = arg;
+    Pipeline *p = s->p;
+
+    pthread_mutex_lock(&p->lock);
+    while (!p->quit) {
+        if (stage_run_call(s))
+            continue;
+        if (s->in && av_fifo_size(s->in->fifo)) {
+            pipe_deliver(s->in, pipe_pop(s->in));
+            continue;
+        }
+        if (s->out && pipe_can_serve(s->out)) {
+            pipe_serve(s->out);
+            continue;
+        }
+        s->waiting = 1;
+        if (p->draining)
+            pthread_cond_signal(&p->stages[0].cond);
+        pthread_cond_wait(&s->cond, &p->lock);
+        s->waiting = 0;
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return NULL;
+}
+
+void ff_pipeline_uninit(AVFilterGraph *graph)
+{
+    Pipeline *p = graph->internal->pipeline;
+    int i;
+
+    if (!p)
+        return;
+
+    pthread_mutex_lock(&p->lock);
+    p->quit = 1;
+    for (i = 0; i < p->nb_stages; i++)
+        pthread_cond_broadcast(&p->stages[i].cond);
+    pthread_mutex_unlock(&p->lock);
+
+    for (i = 1; i < p->nb_threads + 1; i++)
+        pthread_join(p->stages[i].thread, NULL);
+
+    for (i = 0; i < p->nb_pipes; i++) {
+        Pipe *pipe = &p->pipes[i];
+        while (av_fifo_size(pipe->fifo)) {
+            AVFrame *frame;
+            av_fifo_generic_read(pipe->fifo, &frame, sizeof(frame), NULL);
+            av_frame_free(&frame);
+        }
+        av_fifo_freep(&pipe->fifo);
+        pipe->link->pipe = NULL;
+    }
+    for (i = 0; i < p->nb_stages; i++)
+        pthread_cond_destroy(&p->stages[i].cond);
+    for (i = 0; i < graph->nb_filters; i++)
+        graph->filters[i]->internal->pipeline_stage = NULL;
+
+    pthread_mutex_destroy(&p->lock);
+    av_freep(&p->stages);
+    av_freep(&p->pipes);
+    av_freep(&graph->internal->pipeline);
+}
+
+int ff_pipeline_init(AVFilterGraph *graph)
+{
+    Pipeline *p;
+    int *stage_of;
+    int i, j, nb_stages, nb_links = 0, ret;
+
+    stage_of = av_malloc_array(graph->nb_filters, sizeof(*stage_of));
+    if (!stage_of)
+        return AVERROR(ENOMEM);
+    nb_stages = assign_stages(graph, stage_of);
+    if (nb_stages == 1) {
+        av_free(stage_of);
+        return 0;
+    }
+
+    for (i = 0; i < graph->nb_filters; i++)
+        nb_links += graph->filters[i]->nb_outputs;
+
+    p = av_mallocz(sizeof(*p));
+    if (p) {
+        p->stages = av_mallocz_array(nb_stages, sizeof(*p->stages));
+        p->pipes  = av_mallocz_array(nb_links,  sizeof(*p->pipes));
+    }
+    if (!p || !p->stages || !p->pipes) {
+        if (p) {
+            av_freep(&p->stages);
+            av_freep(&p->pipes);
+        }
+        av_freep(&p);
+        av_free(stage_of);
+        return AVERROR(ENOMEM);
+    }
+
+    pthread_mutex_init(&p->lock, NULL);
+    p->nb_stages = nb_stages;
+    for (i = 0; i < nb_stages; i++) {
+        p->stages[i].p = p;
+        pthread_cond_init(&p->stages[i].cond, NULL);
+    }
+    graph->internal->pipeline = p;
+
+    for (i = 0; i < graph->nb_filters; i++) {
+        AVFilterContext *ctx = graph->filters[i];
+        PipelineStage *s = &p->stages[stage_of[i]];
+
+        if (s != &p->stages[0] && !s->filter)
+            s->filter = ctx;
+        ctx->internal->pipeline_stage = s;
+    }
+    av_free(stage_of);
+
+    for (i = 0; i < graph->nb_filters; i++) {
+        AVFilterContext *ctx = graph->filters[i];
+
+        for (j = 0; j < ctx->nb_outputs; j++) {
+            AVFilterLink *link = ctx->outputs[j];
+            Pipe *pipe;
+
+            if (!link || link->src->internal->pipeline_stage ==
+                         link->dst->internal->pipeline_stage)
+                continue;
+
+            /* both ends may allocate frames on the link, create its pool
+             * before they run concurrently */
+            if (link->type == AVMEDIA_TYPE_VIDEO && !link->frame_pool) {
+                link->frame_pool = ff_video_frame_pool_alloc(32);
+                if (!link->frame_pool) {
+                    ret = AVERROR(ENOMEM);
+                    goto fail;
+                }
+            }
+
+            pipe = &p->pipes[p->nb_pipes++];
+            pipe->link    = link;
+            pipe->src     = link->src->internal->pipeline_stage;
+            pipe->dst     = link->dst->internal->pipeline_stage;
+            pipe->fifo    = av_fifo_alloc(PIPE_QUEUE_SIZE * sizeof(AVFrame *));
+            if (!pipe->fifo) {
+                ret = AVERROR(ENOMEM);
+                goto fail;
+            }
+            if (pipe->src->filter)
+                pipe->src->out = pipe;
+            if (pipe->dst->filter)
+                pipe->dst->in = pipe;
+            link->pipe = pipe;
+        }
+    }
+
+    /* the threads look each other up in stages[], let them start together */
+    pthread_mutex_lock(&p->lock);
+    for (i = 1; i < nb_stages; i++) {
+        ret = pthread_create(&p->stages[i].thread, NULL, worker, &p->stages[i]);
+        if (ret) {
+            pthread_mutex_unlock(&p->lock);
+            ret = AVERROR(ret);
+            goto fail;
+        }
+        p->nb_threads++;
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    av_log(graph, AV_LOG_VERBOSE, "Running %d filters on their own threads\n",
+           p->nb_threads);
+
+    return 0;
+fail:
+    ff_pipeline_uninit(graph);
+    return ret;
+}
+
+#else
+
+int ff_pipeline_init(AVFilterGraph *graph)
+{
+    av_log(graph, AV_LOG_WARNING, "Frame threading requires pthreads, "
+           "running the filters on a single thread\n");
+    return 0;
+}
+
+void ff_pipeline_uninit(AVFilterGraph *graph)
+{
+}
+
+int ff_pipeline_filter_frame(AVFilterLink *link, AVFrame *frame)
+{
+    av_frame_free(&frame);
+    return AVERROR_BUG;
+}
+
+int ff_pipeline_request_frame(AVFilterLink *link)
+{
+    return AVERROR_BUG;
+}
+
+int ff_pipeline_poll_frame(AVFilterLink *link)
+{
+    return AVERROR_BUG;
+}
+
+void ff_pipeline_deliver(AVFilterLink *link)
+{
+}
+
+void ff_pipeline_drain(AVFilterGraph *graph)
+{
+}
+
+int ff_pipeline_call(AVFilterContext *ctx,
+                     int (*func)(AVFilterContext *ctx, void *arg), void *arg)
+{
+    return func(ctx, arg);
+}
+
+#endif /* HAVE_PTHREADS */
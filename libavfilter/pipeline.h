@@ -0,0 +1,90 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_PIPELINE_H
+#define AVFILTER_PIPELINE_H
+
+#include "avfilter.h"
+
+/**
+ * @file
+ * Frame-level pipelining of a filter graph.
+ *
+ * Every filter in a chain of filters with one output and at most one input
+ * starting at a buffer source or a source filter, except the buffer source
+ * itself, runs on a thread of its own, unless it allocates the frames of its
+ * input, in which case it runs on the thread of the filter feeding it. All
+ * other filters run on the caller's thread, inside the libavfilter API
+ * calls. Links between filters running on different threads carry a bounded
+ * queue of frames, and their AVFilterLink.pipe is set.
+ */
+
+/**
+ * Start the pipeline threads of a configured graph.
+ */
+int ff_pipeline_init(AVFilterGraph *graph);
+
+/**
+ * Stop the pipeline threads and drop the queued frames.
+ */
+void ff_pipeline_uninit(AVFilterGraph *graph);
+
+/**
+ * Queue a frame on a pipelined link. Called by ff_filter_frame() on the
+ * thread of the source filter.
+ */
+int ff_pipeline_filter_frame(AVFilterLink *link, AVFrame *frame);
+
+/**
+ * Pass a queued frame of a pipelined link to its destination, waiting for
+ * one if necessary. Called by ff_request_frame() on the thread of the
+ * destination filter.
+ *
+ * @return the return value of the destination filter_frame(), or
+ *         AVERROR(EAGAIN) if the source needs more input from the caller,
+ *         or the status the source ended with
+ */
+int ff_pipeline_request_frame(AVFilterLink *link);
+
+/**
+ * Return the number of frames queued on a pipelined link.
+ */
+int ff_pipeline_poll_frame(AVFilterLink *link);
+
+/**
+ * Pass all the frames already queued on link to its destination, without
+ * waiting. Does nothing if the link is not pipelined.
+ */
+void ff_pipeline_deliver(AVFilterLink *link);
+
+/**
+ * Wait until the pipeline threads fed by the buffer sources have processed
+ * all the frames sent to them, passing the frames they produce for the
+ * filters on the caller's thread on to these filters. Afterwards the graph
+ * is in the state it would be in without pipelining. Called on the caller's
+ * thread.
+ */
+void ff_pipeline_drain(AVFilterGraph *graph);
+
+/**
+ * Call func(ctx, arg) on the thread running ctx and return its result.
+ */
+int ff_pipeline_call(AVFilterContext *ctx,
+                     int (*func)(AVFilterContext *ctx, void *arg), void *arg);
+
+#endif /* AVFILTER_PIPELINE_H */
@@ -24,8 +24,10 @@
 
 #include "config.h"
 
+#include "libavutil/atomic.h"
 #include "libavutil/common.h"
 #include "libavutil/cpu.h"
+#include "libavutil/executor.h"
 #include "libavutil/mem.h"
 
 #include "avfilter.h"
@@ -40,59 +42,110 @@
 #include "compat/w32pthreads.h"
 #endif
 
+/* Number of polls of the shared counters before an idle thread sleeps. */
+#define SPIN_COUNT 2000
+
+/* Hint to the CPU that this is a polling loop, so that it does not starve
+ * the other hardware thread of the core. */
+#if ARCH_X86 && HAVE_INLINE_ASM
+#define spin_pause() __asm__ volatile ("pause")
+#else
+#define spin_pause() do { } while (0)
+#endif
+
 typedef struct ThreadContext {
     AVFilterGraph *graph;
 
-    int nb_threads;
-    pthread_t *workers;
-    avfilter_action_func *func;
+    int nb_threads;                 ///< number of threads running jobs, the caller included
+    pthread_t *workers;             ///< the nb_threads - 1 other threads
+    int spin_count;
 
     /* per-execute perameters */
+    avfilter_action_func *func;
     AVFilterContext *ctx;
     void *arg;
     int   *rets;
     int nb_rets;
     int nb_jobs;
 
-    pthread_cond_t last_job_cond;
-    pthread_cond_t current_job_cond;
-    pthread_mutex_t current_job_lock;
-    int current_job;
-    unsigned int current_execute;
-    int done;
+    /**
+     * Incremented twice per execute: it is odd while the caller sets the
+     * parameters above, and even while the jobs may be claimed.
+     */
+    volatile int current_execute;
+    volatile int current_job;       ///< next job to claim
+    volatile int nb_finished;       ///< number of jobs of the current execute done
+    volatile int nb_active;         ///< number of workers claiming jobs
+    volatile int nb_parked;         ///< number of workers waiting on execute_cond
+    volatile int caller_parked;     ///< the caller waits on finished_cond, for nb_finished or nb_active
+    volatile int done;
+
+    pthread_cond_t execute_cond;
+    pthread_cond_t finished_cond;
+    pthread_mutex_t lock;
+    pthread_mutex_t execute_lock;   ///< serializes executes from pipelined filters
 } ThreadContext;
 
+static void wake_caller(ThreadContext *c)
+{
+    if (avpriv_atomic_int_get(&c->caller_parked)) {
+        pthread_mutex_lock(&c->lock);
+        pthread_cond_signal(&c->finished_cond);
+        pthread_mutex_unlock(&c->lock);
+    }
+}
+
+static void run_jobs(ThreadContext *c)
+{
+    int nb_jobs = c->nb_jobs;
+    int job;
+
+    while ((job = avpriv_atomic_int_add_and_fetch(&c->current_job, 1) - 1) < nb_jobs) {
+        c->rets[job % c->nb_rets] = c->func(c->ctx, c->arg, job, nb_jobs);
+
+        if (avpriv_atomic_int_add_and_fetch(&c->nb_finished, 1) == nb_jobs)
+            wake_caller(c);
+    }
+}
+
+static int execute_pending(ThreadContext *c, int last_execute, int *execute)
+{
+    *execute = avpriv_atomic_int_get(&c->current_execute);
+    return *execute != last_execute && !(*execute & 1);
+}
+
 static void* attribute_align_arg worker(void *v)
 {
     ThreadContext *c = v;
-    int our_job      = c->nb_jobs;
-    int nb_threads   = c->nb_threads;
-    unsigned int last_execute = 0;
-    int self_id;
+    int last_execute = 0;
+    int execute, i;
 
-    pthread_mutex_lock(&c->current_job_lock);
-    self_id = c->current_job++;
     for (;;) {
-        while (our_job >= c->nb_jobs) {
-            if (c->current_job == nb_threads + c->nb_jobs)
-                pthread_cond_signal(&c->last_job_cond);
-
-            while (last_execute == c->current_execute && !c->done)
-                pthread_cond_wait(&c->current_job_cond, &c->current_job_lock);
-            last_execute = c->current_execute;
-            our_job = self_id;
-
-            if (c->done) {
-                pthread_mutex_unlock(&c->current_job_lock);
-                return NULL;
-            }
+        for (i = 0; i < c->spin_count; i++) {
+            if (execute_pending(c, last_execute, &execute) ||
+                avpriv_atomic_int_get(&c->done))
+                break;
+            spin_pause();
         }
-        pthread_mutex_unlock(&c->current_job_lock);
-
-        c->rets[our_job % c->nb_rets] = c->func(c->ctx, c->arg, our_job, c->nb_jobs);
-
-        pthread_mutex_lock(&c->current_job_lock);
-        our_job = c->current_job++;
+        if (i == c->spin_count) {
+            pthread_mutex_lock(&c->lock);
+            avpriv_atomic_int_add_and_fetch(&c->nb_parked, 1);
+            while (!execute_pending(c, last_execute, &execute) && !c->done)
+                pthread_cond_wait(&c->execute_cond, &c->lock);
+            avpriv_atomic_int_add_and_fetch(&c->nb_parked, -1);
+            pthread_mutex_unlock(&c->lock);
+        }
+        if (avpriv_atomic_int_get(&c->done))
+            return NULL;
+
+        /* The execute may have ended and the next one be in setup already;
+         * the caller does not touch the counters while nb_active is set. */
+        avpriv_atomic_int_add_and_fetch(&c->nb_active, 1);
+        if (avpriv_atomic_int_get(&c->current_execute) == execute)
+            run_jobs(c);
+        if (!avpriv_atomic_int_add_and_fetch(&c->nb_active, -1))
+            wake_caller(c);
+        last_execute = execute;
     }
 }
 
@@ -100,39 +153,69 @@ static void slice_thread_uninit(ThreadContext *c)
 {
     int i;
 
-    pthread_mutex_lock(&c->current_job_lock);
-    c->done = 1;
-    pthread_cond_broadcast(&c->current_job_cond);
-    pthread_mutex_unlock(&c->current_job_lock);
+    pthread_mutex_lock(&c->lock);
+    avpriv_atomic_int_set(&c->done, 1);
+    pthread_cond_broadcast(&c->execute_cond);
+    pthread_mutex_unlock(&c->lock);
 
-    for (i = 0; i < c->nb_threads; i++)
+    for (i = 0; i < c->nb_threads - 1; i++)
          pthread_join(c->workers[i], NULL);
 
-    pthread_mutex_destroy(&c->current_job_lock);
-    pthread_cond_destroy(&c->current_job_cond);
-    pthread_cond_destroy(&c->last_job_cond);
+    pthread_mutex_destroy(&c->lock);
+    pthread_mutex_destroy(&c->execute_lock);
+    pthread_cond_destroy(&c->execute_cond);
+    pthread_cond_destroy(&c->finished_cond);
     av_freep(&c->workers);
 }
 
-static void slice_thread_park_workers(ThreadContext *c)
+static int workers_idle(ThreadContext *c)
 {
-    while (c->current_job != c->nb_threads + c->nb_jobs)
-        pthread_cond_wait(&c->last_job_cond, &c->current_job_lock);
-    pthread_mutex_unlock(&c->current_job_lock);
+    return !avpriv_atomic_int_get(&c->nb_active);
+}
+
+static int jobs_finished(ThreadContext *c)
+{
+    return avpriv_atomic_int_get(&c->nb_finished) == c->nb_jobs;
+}
+
+/**
+ * Wait in the caller until cond(c) holds. Polls first, then sleeps on
+ * finished_cond; the workers signal it when they make cond true.
+ */
+static void caller_wait(ThreadContext *c, int (*cond)(ThreadContext *c))
+{
+    int i;
+
+    for (i = 0; i < c->spin_count; i++) {
+        if (cond(c))
+            return;
+        spin_pause();
+    }
+    pthread_mutex_lock(&c->lock);
+    avpriv_atomic_int_set(&c->caller_parked, 1);
+    while (!cond(c))
+        pthread_cond_wait(&c->finished_cond, &c->lock);
+    avpriv_atomic_int_set(&c->caller_parked, 0);
+    pthread_mutex_unlock(&c->lock);
 }
 
 static int thread_execute(AVFilterContext *ctx, avfilter_action_func *func,
                           void *arg, int *ret, int nb_jobs)
 {
     ThreadContext *c = ctx->graph->internal->thread;
-    int dummy_ret;
+    int dummy_ret, execute;
 
     if (nb_jobs <= 0)
         return 0;
 
-    pthread_mutex_lock(&c->current_job_lock);
+    pthread_mutex_lock(&c->execute_lock);
+
+    execute = (c->current_execute + 1U) & INT_MAX;
+    avpriv_atomic_int_set(&c->current_execute, execute);
+    caller_wait(c, workers_idle);
 
-    c->current_job = c->nb_threads;
+    c->current_job = 0;
+    c->nb_finished = 0;
     c->nb_jobs     = nb_jobs;
     c->ctx         = ctx;
     c->arg         = arg;
@@ -144,60 +227,86 @@ static int thread_execute(AVFilterContext *ctx, avfilter_action_func *func,
         c->rets    = &dummy_ret;
         c->nb_rets = 1;
     }
-    c->current_execute++;
 
-    pthread_cond_broadcast(&c->current_job_cond);
+    avpriv_atomic_int_set(&c->current_execute, (execute + 1U) & INT_MAX);
+    if (avpriv_atomic_int_get(&c->nb_parked)) {
+        pthread_mutex_lock(&c->lock);
+        pthread_cond_broadcast(&c->execute_cond);
+        pthread_mutex_unlock(&c->lock);
+    }
+
+    run_jobs(c);
+    caller_wait(c, jobs_finished);
 
-    slice_thread_park_workers(c);
+    pthread_mutex_unlock(&c->execute_lock);
 
     return 0;
 }
 
 static int thread_init_internal(ThreadContext *c, int nb_threads)
 {
+    int nb_cpus = av_cpu_count();
     int i, ret;
 
-    if (!nb_threads) {
-        int nb_cpus = av_cpu_count();
-        // use number of cores + 1 as thread count if there is more than one
-        if (nb_cpus > 1)
-            nb_threads = nb_cpus + 1;
-        else
-            nb_threads = 1;
-    }
+    // the caller runs jobs too, so one thread per core is enough
+    if (!nb_threads)
+        nb_threads = nb_cpus;
 
     if (nb_threads <= 1)
         return 1;
 
     c->nb_threads = nb_threads;
-    c->workers = av_mallocz_array(sizeof(*c->workers), nb_threads);
+    c->workers = av_mallocz_array(sizeof(*c->workers), nb_threads - 1);
     if (!c->workers)
         return AVERROR(ENOMEM);
 
-    c->current_job = 0;
-    c->nb_jobs     = 0;
-    c->done        = 0;
+    // spinning only helps if the thread being waited for runs meanwhile
+    c->spin_count      = nb_cpus > 1 ? SPIN_COUNT : 0;
+    c->current_execute = 0;
+    c->nb_active       = 0;
+    c->nb_parked       = 0;
+    c->caller_parked   = 0;
+    c->done            = 0;
 
-    pthread_cond_init(&c->current_job_cond, NULL);
-    pthread_cond_init(&c->last_job_cond,    NULL);
+    pthread_cond_init(&c->execute_cond,  NULL);
+    pthread_cond_init(&c->finished_cond, NULL);
 
-    pthread_mutex_init(&c->current_job_lock, NULL);
-    pthread_mutex_lock(&c->current_job_lock);
-    for (i = 0; i < nb_threads; i++) {
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_mutex_init(&c->execute_lock, NULL);
+    for (i = 0; i < nb_threads - 1; i++) {
         ret = pthread_create(&c->workers[i], NULL, worker, c);
         if (ret) {
-           pthread_mutex_unlock(&c->current_job_lock);
-           c->nb_threads = i;
+           c->nb_threads = i + 1;
            slice_thread_uninit(c);
            return AVERROR(ret);
         }
     }
 
-    slice_thread_park_workers(c);
-
     return c->nb_threads;
 }
 
+typedef struct ExecutorJob {
+    avfilter_action_func *func;
+    AVFilterContext *ctx;
+    int nb_jobs;
+} ExecutorJob;
+
+static int executor_job(void *opaque, void *arg, int jobnr, int threadnr)
+{
+    ExecutorJob *job = opaque;
+    return job->func(job->ctx, arg, jobnr, job->nb_jobs);
+}
+
+static int executor_execute(AVFilterContext *ctx, avfilter_action_func *func,
+                            void *arg, int *ret, int nb_jobs)
+{
+    AVFilterGraph *graph = ctx->graph;
+    ExecutorJob job = { func, ctx, nb_jobs };
+
+    return av_executor_execute(graph->executor, executor_job, &job, arg, ret,
+                               nb_jobs, graph->nb_threads, graph->executor_priority);
+}
+
 int ff_graph_thread_init(AVFilterGraph *graph)
 {
     int ret;
@@ -207,7 +316,14 @@ int ff_graph_thread_init(AVFilterGraph *graph)
 #endif
 
     if (graph->nb_threads == 1) {
-        graph->thread_type = 0;
+        graph->thread_type &= ~AVFILTER_THREAD_SLICE;
+        return 0;
+    }
+
+    if (graph->executor) {
+        if (!graph->nb_threads)
+            graph->nb_threads = av_executor_get_nb_threads(graph->executor) + 1;
+        graph->internal->thread_execute = executor_execute;
         return 0;
     }
 
@@ -218,7 +334,7 @@ int ff_graph_thread_init(AVFilterGraph *graph)
     ret = thread_init_internal(graph->internal->thread, graph->nb_threads);
     if (ret <= 1) {
         av_freep(&graph->internal->thread);
-        graph->thread_type = 0;
+        graph->thread_type &= ~AVFILTER_THREAD_SLICE;
         graph->nb_threads  = 1;
         return (ret < 0) ? ret : 0;
     }
@@ -42,6 +42,7 @@ typedef struct MergePlanesContext {
     int nb_planes;
     int planewidth[4];
     int planeheight[4];
+    int linesize[4];
     int map[4][2];
     const AVPixFmtDescriptor *outdesc;
 
@@ -162,7 +163,7 @@ static int process_frame(FFFrameSync *fs)
 
         av_image_copy_plane(out->data[i], out->linesize[i],
                             in[input]->data[plane], in[input]->linesize[plane],
-                            s->planewidth[i], s->planeheight[i]);
+                            s->linesize[i], s->planeheight[i]);
     }
 
     return ff_filter_frame(outlink, out);
@@ -174,7 +175,7 @@ static int config_output(AVFilterLink *outlink)
     MergePlanesContext *s = ctx->priv;
     InputParam inputsp[4];
     FFFrameSyncIn *in;
-    int i;
+    int i, ret;
 
     ff_framesync_init(&s->fs, ctx, s->nb_inputs);
     in = s->fs.in;
@@ -196,6 +197,9 @@ static int config_output(AVFilterLink *outlink)
     s->planeheight[0] =
     s->planeheight[3] = outlink->h;
 
+    if ((ret = av_image_fill_linesizes(s->linesize, s->out_fmt, outlink->w)) < 0)
+        return ret;
+
     for (i = 0; i < s->nb_inputs; i++) {
         InputParam *inputp = &inputsp[i];
         AVFilterLink *inlink = ctx->inputs[i];
@@ -616,13 +616,13 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *inpicref)
     if (oright != oleft) {
         if (s->out.format == ALTERNATING_LR)
             FFSWAP(AVFrame *, oleft, oright);
-        oright->pts = outlink->frame_count * s->ts_unit;
+        oright->pts = outlink->frame_count_in * s->ts_unit;
         ff_filter_frame(outlink, oright);
         out = oleft;
-        oleft->pts = outlink->frame_count * s->ts_unit;
+        oleft->pts = outlink->frame_count_in * s->ts_unit;
     } else if (s->in.format == ALTERNATING_LR ||
                s->in.format == ALTERNATING_RL) {
-        out->pts = outlink->frame_count * s->ts_unit;
+        out->pts = outlink->frame_count_in * s->ts_unit;
     }
     return ff_filter_frame(outlink, out);
 }
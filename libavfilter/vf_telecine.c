@@ -166,6 +166,17 @@ static int config_output(AVFilterLink *outlink)
     return 0;
 }
 
+/* The output frames are references to s->frame[], do not overwrite them
+ * while they are still in use further down the graph. */
+static int make_frame_writable(AVFilterLink *inlink, AVFrame **frame)
+{
+    if (av_frame_is_writable(*frame))
+        return 0;
+    av_frame_free(frame);
+    *frame = ff_get_video_buffer(inlink, inlink->w, inlink->h);
+    return *frame ? 0 : AVERROR(ENOMEM);
+}
+
 static int filter_frame(AVFilterLink *inlink, AVFrame *inpicref)
 {
     AVFilterContext *ctx = inlink->dst;
@@ -185,6 +196,10 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *inpicref)
     }
 
     if (s->occupied) {
+        if ((ret = make_frame_writable(inlink, &s->frame[nout])) < 0) {
+            av_frame_free(&inpicref);
+            return ret;
+        }
         for (i = 0; i < s->nb_planes; i++) {
             // fill in the EARLIER field from the buffered pic
             av_image_copy_plane(s->frame[nout]->data[i] + s->frame[nout]->linesize[i] * s->first_field,
@@ -207,6 +222,10 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *inpicref)
     }
 
     while (len >= 2) {
+        if ((ret = make_frame_writable(inlink, &s->frame[nout])) < 0) {
+            av_frame_free(&inpicref);
+            return ret;
+        }
         // output THIS image as-is
         for (i = 0; i < s->nb_planes; i++)
             av_image_copy_plane(s->frame[nout]->data[i], s->frame[nout]->linesize[i],
@@ -235,7 +254,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *inpicref)
             return AVERROR(ENOMEM);
         }
 
-        frame->pts = outlink->frame_count * s->ts_unit;
+        frame->pts = outlink->frame_count_in * s->ts_unit;
         ret = ff_filter_frame(outlink, frame);
     }
     av_frame_free(&inpicref);
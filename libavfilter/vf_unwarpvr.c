@@ -31,19 +31,32 @@
 #include <string.h>
 #include <jansson.h>
 
+#include "config.h"
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 #include "avfilter.h"
 #include "formats.h"
 #include "internal.h"
 #include "video.h"
+#include "vf_unwarpvr.h"
+#include "libavutil/adler32.h"
+#include "libavutil/atomic.h"
 #include "libavutil/avstring.h"
+#include "libavutil/buffer.h"
 #include "libavutil/eval.h"
+#include "libavutil/file.h"
 #include "libavutil/internal.h"
+#include "libavutil/intreadwrite.h"
 #include "libavutil/mathematics.h"
 #include "libavutil/opt.h"
 #include "libavutil/parseutils.h"
 #include "libavutil/pixdesc.h"
+#include "libavutil/pixelutils.h"
 #include "libavutil/imgutils.h"
 #include "libavutil/avassert.h"
+#include "libavutil/random_seed.h"
 #include "libswscale/swscale.h"
 
 #ifdef _WIN32
@@ -84,10 +97,165 @@ enum var_name {
     VARS_NB
 };
 
+enum InterpMode {
+    INTERP_NEAREST,
+    INTERP_BILINEAR,
+    INTERP_BICUBIC,
+    NB_INTERP_MODE
+};
+
+enum OutputsMode {
+    OUTPUTS_STEREO,     ///< one output with both eyes side by side
+    OUTPUTS_LEFT,       ///< one output with the left eye
+    OUTPUTS_RIGHT,      ///< one output with the right eye
+    OUTPUTS_BOTH_EYES,  ///< a left and a right output
+    NB_OUTPUTS_MODE
+};
+
+enum Projection {
+    PROJECTION_RECTILINEAR, ///< a flat view of what the lens shows
+    PROJECTION_EQUIRECT,    ///< longitude and latitude, linear in angle
+    PROJECTION_CUBEMAP,     ///< six 90 degree faces in a 3x2 grid per eye
+    NB_PROJECTION
+};
+
+#define INTERP_FRAC_BITS 7
+#define INTERP_FRAC_ONE  (1 << INTERP_FRAC_BITS)
+#define CUBIC_COEF_BITS  10
+
+#define CONV_BITS 15
+
+#define COMPACT_FRAC_BITS 4
+#define CA_LUT_SIZE       1024
+
+/* Rows near the lens edges are mostly blank and cheap, so split the frame
+ * into more slices than threads to keep all of them busy until the end. */
+#define SLICES_PER_THREAD 4
+
+/**
+ * Entry of the compact remap table: source position of the green sample of
+ * one output pixel, relative to the output position scaled to the input.
+ * Red and blue are derived from it through the radial chromatic aberration
+ * ratio, which only depends on the distance from the lens centre.
+ */
+typedef struct CompactMapEntry {
+    int16_t dx, dy;             ///< in 1/(1 << COMPACT_FRAC_BITS) pixels, dx = INT16_MIN if unmapped
+} CompactMapEntry;
+
+typedef struct CompactColumn {
+    float rsq;                  ///< horizontal term of the squared radius
+    int base_x;                 ///< output column scaled to the input, -1 if no eye covers it
+    int eye;
+} CompactColumn;
+
+typedef struct CompactRow {
+    float rsq;                  ///< vertical term of the squared radius
+    int base_y;
+} CompactRow;
+
+/**
+ * Entries [start, end) of one half of an output row, the part of the row
+ * covered by an eye. All entries of the half outside the span are invalid.
+ */
+typedef struct RowSpan {
+    int start, end;
+} RowSpan;
+
+#define TABLE_MAGIC   MKTAG('U','V','R','T')
+#define TABLE_VERSION 9
+#define TABLE_ALIGN   64
+
+/**
+ * Everything a remap table depends on. Compared with memcmp(), so it must be
+ * zeroed before being filled in.
+ */
+typedef struct UnwarpVRTableKey {
+    char device[16];
+    char sdkversion[16];
+    int format;
+    int in_w, in_h;
+    int out_w, out_h;
+    int in_h_chr_pos, in_v_chr_pos;
+    int out_h_chr_pos, out_v_chr_pos;
+    int swap_eyes;
+    int left_eye_only;
+    int mono_input;
+    int forward_warp;
+    int eye_relief_dial;
+    int interp;
+    int compact;
+    int symmetric;
+    int correct_ca;
+    int projection;
+    float scale_width, scale_height;
+    float scale_in_width, scale_in_height;
+    float ppd;
+} UnwarpVRTableKey;
+
+/**
+ * Header of a remap table. The table is a single position independent block
+ * so that it can be shared between filter instances and mapped from disk;
+ * the arrays follow the header at the given byte offsets, 0 if absent.
+ *
+ * Files are written in native byte order and are not portable between
+ * machines of different endianness; the magic doubles as the byte order
+ * mark, so such a file is rejected and rebuilt.
+ */
+typedef struct UnwarpVRTable {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;              ///< size of the whole block in bytes
+    uint32_t checksum;          ///< Adler-32 of everything from key up to size
+    UnwarpVRTableKey key;
+    uint64_t inv_cache_offset;
+    uint64_t inv_frac_offset;
+    uint64_t compact_map_offset;
+    uint64_t compact_cols_offset;
+    uint64_t compact_rows_offset;
+    uint64_t spans_offset;      ///< two RowSpans per output row of each plane
+    int compact_eye_x[2];       ///< left edge of each output eye's view in the input
+    float compact_cx[2];        ///< lens centre of each output eye's view, relative to its left edge
+    float compact_cy;
+    float ca_ratio[2][CA_LUT_SIZE + 2]; ///< red and blue radial scale relative to green, by rsq
+    float ca_lut_scale;
+} UnwarpVRTable;
+
+/**
+ * Layout of one remapped plane. Packed RGB is a single plane with one table
+ * entry per sample of each output pixel, or one per pixel if whole_pixel is
+ * set; planar formats have one entry per sample.
+ */
+typedef struct UnwarpVRPlane {
+    int step;                   ///< distance in bytes between horizontally adjacent input samples
+    int sample_size;            ///< size of a sample in bytes, 1 or 2
+    int depth;                  ///< significant bits per sample
+    int eye_w, h;               ///< size of an eye's view in the input plane, in samples
+    int out_w, out_h;           ///< size of the output plane, in samples
+    int nb_comp;                ///< table entries per output sample
+    int channel[4];             ///< RGB channel whose distortion is used for each entry of a sample
+    int whole_pixel;            ///< entries address whole 32-bit pixels instead of single bytes
+    int hsub, vsub;             ///< log2 of the chroma subsampling
+    float in_h_chr_pos, in_v_chr_pos;   ///< position of the first sample on the luma grid
+    float out_h_chr_pos, out_v_chr_pos;
+    int fill;                   ///< value of samples outside the input view
+    size_t map_offset;          ///< index of the plane's first entry in inv_cache
+    size_t spans_offset;        ///< index of the plane's first row in spans
+
+    /**
+     * The right eye's view is the left one's mirrored about the output
+     * column out_w / 2, and the bottom half is the top one's mirrored about
+     * the row out_h / 2. Only the top left part of sym_w by sym_h samples is
+     * computed; the other entries are its reflections.
+     */
+    int mirror_x, mirror_y;
+    int sym_w, sym_h;
+    size_t sym_offset;          ///< index of the plane's first entry in a symmetric table
+    int reflect_x[4];           ///< x of an entry mirrored to the other eye is reflect_x[k] - x
+    int reflect_y;              ///< y of an entry mirrored to the other half is reflect_y - y
+} UnwarpVRPlane;
+
 typedef struct UnwarpVRContext {
     const AVClass *class;
-    struct SwsContext *sws;     ///< software scaler context
-    struct SwsContext *isws[2]; ///< software scaler context for interlaced material
     AVDictionary *opts;
 
     /**
@@ -102,8 +270,6 @@ typedef struct UnwarpVRContext {
 
     int hsub, vsub;             ///< chroma subsampling
     int slice_y;                ///< top of current output slice
-    int input_is_pal;           ///< set to 1 if the input format is paletted
-    int output_is_pal;          ///< set to 1 if the output format is paletted
     int interlaced;
 
     char *w_expr;               ///< width  expression string
@@ -136,7 +302,71 @@ typedef struct UnwarpVRContext {
     char *sdkversion;
     int mono_input;
 
-    int* inv_cache;
+    int interp;
+    int correct_ca;
+    int outputs;                ///< OutputsMode
+    int projection;             ///< Projection of the unwarped output
+    int out_pix_fmt;            ///< YUV format packed RGB input is converted to in the same pass, or none
+    int conv_hsub, conv_vsub;   ///< chroma subsampling of out_pix_fmt
+    int rgb_offset[3];          ///< byte offset of R, G and B in an input pixel
+    int conv_coeffs[3][3];      ///< RGB to Y, U and V, 1 << CONV_BITS is 1.0
+    int conv_y_offset;
+    enum AVColorSpace conv_colorspace;
+    enum AVColorRange conv_range;
+    uint8_t *rgb_buf;           ///< per slice remapped RGB rows waiting to be converted
+    size_t rgb_buf_size;        ///< bytes of rgb_buf belonging to each slice
+    int rgb_linesize;
+    int out_x[2];               ///< first column of each output in the stereo view
+    int out_w;                  ///< width of each output
+    UnwarpVRDSPContext dsp;
+
+    int skip_static;
+    int static_thresh;          ///< largest SAD of a 16x16 block of bytes in a static frame
+    av_pixelutils_sad_fn sad;
+    int cmp_w[4], cmp_h[4];     ///< bytes and rows of each input plane to compare
+    int cmp_planes;
+    int *slice_changed;         ///< per slice result of the comparison
+    AVFrame *prev_in;           ///< last input frame that was remapped
+    AVFrame *prev_out[2];       ///< its outputs, made with the current table
+    int64_t nb_frames, nb_static;
+
+    char *map_cache;
+    AVBufferRef *table_ref;     ///< reference to the remap table, possibly shared with other instances
+    UnwarpVRTable *table;
+    int32_t *inv_cache;
+    uint16_t *inv_frac;         ///< fractional source position of each inv_cache entry, x | y << 8
+    RowSpan (*spans)[2];        ///< valid entries of each output row
+#if HAVE_PTHREADS
+    pthread_t rebuild_thread;   ///< builds a table for changed options while frames use the old one
+    int rebuild_running;        ///< rebuild_thread has been started and not joined yet
+    volatile int rebuild_done;  ///< set by rebuild_thread when rebuilt_table and rebuild_ret are final
+    int rebuild_ret;
+    AVBufferRef *rebuilt_table;
+    struct UnwarpVRContext *rebuild_ctx; ///< copy of the filter state the table is built for
+#endif
+    int rebuild_pending;        ///< table options changed since the last rebuild was started
+    int rebuild_wait;           ///< wait for a rebuilt table instead of using the old one meanwhile
+    UnwarpVRPlane planes[3];
+    int nb_planes;
+    size_t nb_entries;          ///< total number of inv_cache entries of all planes
+    size_t nb_rows;             ///< total number of output rows of all planes
+    int16_t cubic_coeffs[INTERP_FRAC_ONE + 1][4];
+    int nb_slices;
+
+    int symmetric;
+    size_t nb_sym_entries;      ///< number of entries of a symmetric table
+
+    int compact;
+    CompactMapEntry *compact_map;
+    CompactColumn *compact_cols;
+    CompactRow *compact_rows;
+    int32_t *row_map;           ///< per slice rows decoded from the compact or symmetric table
+    uint16_t *row_frac;
+    size_t row_buf_size;        ///< entries of row_map and row_frac belonging to each slice
+
+    int band_rows;              ///< output rows remapped and converted together, whole chroma rows
+    void (*remap_row)(const struct UnwarpVRContext *unwarpvr, const UnwarpVRPlane *plane, uint8_t *dst,
+                      const uint8_t *src, int linesize, const int32_t *map, const uint16_t *frac, int n);
 } UnwarpVRContext;
 
 static av_cold int ovr_parse_error(AVFilterContext *ctx, json_t *root, const char *reason)
@@ -283,6 +513,8 @@ static av_cold char* join_string_list(char* buffer, const size_t size, const cha
     return buffer;
 }
 
+static int config_props(AVFilterLink *outlink);
+
 static av_cold int init_dict(AVFilterContext *ctx, AVDictionary **opts)
 {
     UnwarpVRContext *unwarpvr = ctx->priv;
@@ -337,6 +569,17 @@ static av_cold int init_dict(AVFilterContext *ctx, AVDictionary **opts)
         return AVERROR(EINVAL);
     }
 
+    if (unwarpvr->projection != PROJECTION_RECTILINEAR && (unwarpvr->forward_warp || unwarpvr->compact)) {
+        av_log(ctx, AV_LOG_ERROR, "projection is only supported when unwarping without compact=1\n");
+        return AVERROR(EINVAL);
+    }
+
+    if (unwarpvr->skip_static) {
+        unwarpvr->sad = av_pixelutils_get_sad_fn(4, 4, 0, ctx); // 16x16, not aligned on blocksize
+        if (!unwarpvr->sad)
+            return AVERROR(EINVAL);
+    }
+
     if (unwarpvr->size_str && (unwarpvr->w_expr || unwarpvr->h_expr)) {
         av_log(ctx, AV_LOG_ERROR,
             "Size and width/height expressions cannot be set at the same time.\n");
@@ -379,6 +622,32 @@ static av_cold int init_dict(AVFilterContext *ctx, AVDictionary **opts)
     unwarpvr->opts = *opts;
     *opts = NULL;
 
+    unwarpvr->dsp.remap_nearest   = ff_unwarpvr_remap_nearest_c;
+    unwarpvr->dsp.remap_nearest16 = ff_unwarpvr_remap_nearest16_c;
+    unwarpvr->dsp.remap_nearest32 = ff_unwarpvr_remap_nearest32_c;
+    if (ARCH_X86)
+        ff_unwarpvr_init_x86(&unwarpvr->dsp);
+
+    if (unwarpvr->out_pix_fmt != AV_PIX_FMT_NONE &&
+        unwarpvr->out_pix_fmt != AV_PIX_FMT_YUV420P  && unwarpvr->out_pix_fmt != AV_PIX_FMT_YUV422P  &&
+        unwarpvr->out_pix_fmt != AV_PIX_FMT_YUV444P  && unwarpvr->out_pix_fmt != AV_PIX_FMT_YUVJ420P &&
+        unwarpvr->out_pix_fmt != AV_PIX_FMT_YUVJ422P && unwarpvr->out_pix_fmt != AV_PIX_FMT_YUVJ444P) {
+        av_log(ctx, AV_LOG_ERROR, "Unsupported output pixel format %s\n",
+               av_get_pix_fmt_name(unwarpvr->out_pix_fmt));
+        return AVERROR(EINVAL);
+    }
+
+    for (i = 0; i < (unwarpvr->outputs == OUTPUTS_BOTH_EYES ? 2 : 1); i++) {
+        AVFilterPad pad = { 0 };
+
+        pad.type         = AVMEDIA_TYPE_VIDEO;
+        pad.name         = av_strdup(unwarpvr->outputs != OUTPUTS_BOTH_EYES ? "default" : i ? "right" : "left");
+        pad.config_props = config_props;
+        if (!pad.name)
+            return AVERROR(ENOMEM);
+        ff_insert_outpad(ctx, i, &pad);
+    }
+
     return 0;
 }
 
@@ -437,46 +706,47 @@ static float EvalCatmullRom10Spline(float const *K, float scaledVal)
 }
 
 // From OVR_DeviceConstants.h
-enum DistortionEqnType
-{
-    Distortion_Poly4 = 0,
-    Distortion_RecipPoly4 = 1,
-    Distortion_CatmullRom10 = 2,
-};
-
-// Also based on function from OVR_Stereo.cpp
+enum DistortionEqnType
+{
+    Distortion_Poly4 = 0,
+    Distortion_RecipPoly4 = 1,
+    Distortion_CatmullRom10 = 2,
+};
+
+// Also based on function from OVR_Stereo.cpp
 static float DistortionFnScaleRadiusSquared(enum DistortionEqnType Eqn, float const *K, float MaxR, float const CA0, float const CA1, float rsq)
 {
-    float scale = 1.0f;
-    switch (Eqn)
-    {
-    case Distortion_Poly4:
-        // This version is deprecated! Prefer one of the other two.
-        scale = (K[0] + rsq * (K[1] + rsq * (K[2] + rsq * K[3])));
-        break;
-    case Distortion_RecipPoly4:
-        scale = 1.0f / (K[0] + rsq * (K[1] + rsq * (K[2] + rsq * K[3])));
-        break;
-    case Distortion_CatmullRom10:{
-                                     // A Catmull-Rom spline through the values 1.0, K[1], K[2] ... K[10]
-                                     // evenly spaced in R^2 from 0.0 to MaxR^2
-                                     // K[0] controls the slope at radius=0.0, rather than the actual value.
-                                     float scaledRsq = (float)(NumSegments - 1) * rsq / (MaxR * MaxR);
-                                     scale = EvalCatmullRom10Spline(K, scaledRsq);
-    }break;
-    }
-    scale *= 1.0f + CA0 + CA1 * rsq;
-    return scale;
+    float scale = 1.0f;
+    switch (Eqn)
+    {
+    case Distortion_Poly4:
+        // This version is deprecated! Prefer one of the other two.
+        scale = (K[0] + rsq * (K[1] + rsq * (K[2] + rsq * K[3])));
+        break;
+    case Distortion_RecipPoly4:
+        scale = 1.0f / (K[0] + rsq * (K[1] + rsq * (K[2] + rsq * K[3])));
+        break;
+    case Distortion_CatmullRom10:{
+                                     // A Catmull-Rom spline through the values 1.0, K[1], K[2] ... K[10]
+                                     // evenly spaced in R^2 from 0.0 to MaxR^2
+                                     // K[0] controls the slope at radius=0.0, rather than the actual value.
+                                     float scaledRsq = (float)(NumSegments - 1) * rsq / (MaxR * MaxR);
+                                     scale = EvalCatmullRom10Spline(K, scaledRsq);
+    }break;
+    }
+    scale *= 1.0f + CA0 + CA1 * rsq;
+    return scale;
 }
 
 // Computes inverse of DistortionFnScaleRadiusSquared function using binary search
 // Function is monotonic increasing so this ought to work, although might be slow
+// Only used to fill DistortionInvLUT, so the tolerance is close to float precision
 static float DistortionFnScaleRadiusSquaredInv(enum DistortionEqnType Eqn, float const *K, float MaxR, float const CA0, float const CA1, float rsq)
 {
     float low_guess = 0.0f, high_guess = 10.0f;
     // The "high_guess > 0.00001" is needed for the singular case where zero is the solution
     // With the relative error at 0.001 I observed a dot in the center on some frames, so lowered to 0.0001
-    while ((high_guess - low_guess) / low_guess > 0.0001 && high_guess > 0.00001) {
+    while ((high_guess - low_guess) / low_guess > 0.000001 && high_guess > 0.00001) {
         float mid_guess = (low_guess + high_guess) / 2.0f;
         float scale = DistortionFnScaleRadiusSquared(Eqn, K, MaxR, CA0, CA1, mid_guess);
         float mid_guess_value = scale * scale * mid_guess;
@@ -490,23 +760,139 @@ static float DistortionFnScaleRadiusSquaredInv(enum DistortionEqnType Eqn, float
     return (low_guess + high_guess) / 2.0f;
 }
 
-#define NUM_EYES 2
-#define NUM_CHANNELS 3
+#define INV_LUT_SIZE 4096
 
-static av_cold void uninit(AVFilterContext *ctx)
+/**
+ * DistortionFnScaleRadiusSquaredInv() tabulated over [0, rsq_max], stored as
+ * the ratio of the result to rsq. The ratio is smooth and bounded down to
+ * the centre, where the inverse itself flattens out to 0.
+ */
+typedef struct DistortionInvLUT {
+    float scale;                ///< entries per unit of rsq
+    float ratio[INV_LUT_SIZE + 2];
+} DistortionInvLUT;
+
+static void init_distortion_inv_lut(DistortionInvLUT *lut, enum DistortionEqnType Eqn, float const *K, float MaxR,
+                                    float const CA0, float const CA1, float rsq_max)
 {
-    UnwarpVRContext *unwarpvr = ctx->priv;
-    sws_freeContext(unwarpvr->sws);
-    sws_freeContext(unwarpvr->isws[0]);
-    sws_freeContext(unwarpvr->isws[1]);
-    unwarpvr->sws = NULL;
-    av_dict_free(&unwarpvr->opts);
-    av_freep(&unwarpvr->inv_cache);
+    float scale0 = DistortionFnScaleRadiusSquared(Eqn, K, MaxR, CA0, CA1, 0.0f);
+    int i;
+
+    lut->scale = rsq_max > 0.0f ? INV_LUT_SIZE / rsq_max : 0.0f;
+    lut->ratio[0] = 1.0f / (scale0 * scale0);
+    for (i = 1; i <= INV_LUT_SIZE; i++) {
+        float rsq = i * rsq_max / INV_LUT_SIZE;
+        lut->ratio[i] = DistortionFnScaleRadiusSquaredInv(Eqn, K, MaxR, CA0, CA1, rsq) / rsq;
+    }
+    lut->ratio[INV_LUT_SIZE + 1] = lut->ratio[INV_LUT_SIZE];
+}
+
+/**
+ * @return DistortionFnScaleRadiusSquaredInv(rsq) / rsq, clamped to the end of the table
+ */
+static float distortion_inv_ratio(const DistortionInvLUT *lut, float rsq)
+{
+    float pos = FFMIN(rsq * lut->scale, INV_LUT_SIZE);
+    int i = pos;
+
+    pos -= i;
+    return lut->ratio[i] + (lut->ratio[i + 1] - lut->ratio[i]) * pos;
+}
+
+typedef struct DeviceParams {
+    enum DistortionEqnType Eqn;
+    float K[11];
+    float MaxR;
+    float ChromaticAberration[4];
+    float MetersPerTanAngleAtCenter;
+    float screenWidthMeters;
+    float screenHeightMeters;
+    float LensCenterXOffset;    ///< for left eye, determined by physical parameters
+    int DeviceResX, DeviceResY;
+} DeviceParams;
+
+static int get_device_params(void *log_ctx, const char *device, const char *sdkversion,
+                             int eye_relief_dial, DeviceParams *dev)
+{
+    int i;
+
+    memset(dev, 0, sizeof(*dev));
+    dev->Eqn  = Distortion_CatmullRom10;
+    dev->MaxR = 1.0f;
+
+    if (strcmp(device, "RiftDK1") == 0) {
+        dev->MetersPerTanAngleAtCenter = 0.0425f;
+        dev->screenWidthMeters = 0.14976f;
+        dev->screenHeightMeters = dev->screenWidthMeters / (1280.0f / 800.0f);
+        dev->LensCenterXOffset = 0.15197646600f;
+        dev->DeviceResX = 1280; dev->DeviceResY = 800;
+
+        if (strcmp(sdkversion, "0.2.5c") == 0) {
+            const float K_DK1[] = { 1.0f, 0.212f, 0.24f, 0.0f };
+            const float ChromaticAberrationDK1[] = { 0.996f - 1.0f, -0.004f, 1.014f - 1.0f, 0.0f };
+            dev->Eqn = Distortion_Poly4;
+            memmove(dev->K, K_DK1, sizeof(K_DK1));
+            memmove(dev->ChromaticAberration, ChromaticAberrationDK1, sizeof(dev->ChromaticAberration));
+            dev->MetersPerTanAngleAtCenter = 0.25f * dev->screenWidthMeters; // Ensures TanEyeAngleScaleX = 1.0 to match 0.2.5c behavior
+        }
+        else if (strcmp(sdkversion, "0.4.2") == 0) {
+            // Use minimum eye relief distortion for now, but should be adjusted with eye relief
+            const float K_DK1[] = { 1.0f, 1.06505f, 1.14725f, 1.2705f, 1.48f, 1.87f, 2.534f, 3.6f, 5.1f, 7.4f, 11.0f };
+            const float ChromaticAberrationDK1[] = { -0.006f, 0.0f, 0.014f, 0.0f };
+            memmove(dev->K, K_DK1, sizeof(K_DK1));
+            dev->MaxR = sqrt(1.8f);
+            // ChromaticAbberation does not vary by eye relief in DK1 in SDK 0.4.2
+            memmove(dev->ChromaticAberration, ChromaticAberrationDK1, sizeof(dev->ChromaticAberration));
+        }
+        else {
+            av_log(log_ctx, AV_LOG_ERROR, "Internal error: unhandled SDK version %s\n", sdkversion);
+            return AVERROR(EINVAL);
+        }
+    }
+    else if (strcmp(device, "RiftDK2") == 0) {
+        // Distortion varies by SDK version but never by cup type or eye relief (for DK2 in 0.4.2)
+        const float K_DK2[] = { 1.003f, 1.02f, 1.042f, 1.066f, 1.094f, 1.126f, 1.162f, 1.203f, 1.25f, 1.31f, 1.38f };
+        // ChromaticAbberation varies by eye relief and lerps between the following two arrays
+        const float ChromaticAberrationMin[] = { -0.0112f, -0.015f, 0.0187f, 0.015f };
+        const float ChromaticAberrationMax[] = { -0.015f, -0.02f, 0.025f, 0.02f };
+        memmove(dev->K, K_DK2, sizeof(K_DK2));
+        for (i = 0; i < FF_ARRAY_ELEMS(dev->ChromaticAberration); i++) {
+            dev->ChromaticAberration[i] = ChromaticAberrationMin[i] + eye_relief_dial / 10.0f * (ChromaticAberrationMax[i] - ChromaticAberrationMin[i]);
+        }
+
+        dev->MetersPerTanAngleAtCenter = 0.036f;
+        dev->screenWidthMeters = 0.12576f;
+        dev->screenHeightMeters = 0.07074f;
+        dev->LensCenterXOffset = -0.00986003876f;
+        dev->DeviceResX = 1920; dev->DeviceResY = 1080;
+    }
+    else {
+        av_log(log_ctx, AV_LOG_ERROR,
+            "Invalid device specified. Valid options: RiftDK1, RiftDK2\n");
+        return AVERROR(EINVAL);
+    }
+
+    return 0;
 }
 
+#define NUM_EYES 2
+#define NUM_CHANNELS 3
+
 static int query_formats(AVFilterContext *ctx)
 {
     static const enum AVPixelFormat pix_fmts[] = {
+        AV_PIX_FMT_RGB24, AV_PIX_FMT_BGR24,
+        AV_PIX_FMT_RGBA,  AV_PIX_FMT_BGRA,
+        AV_PIX_FMT_ABGR,  AV_PIX_FMT_ARGB,
+        AV_PIX_FMT_0BGR,  AV_PIX_FMT_0RGB,
+        AV_PIX_FMT_RGB0,  AV_PIX_FMT_BGR0,
+        AV_PIX_FMT_RGB48, AV_PIX_FMT_BGR48,
+        AV_PIX_FMT_GBRP,  AV_PIX_FMT_GBRP10, AV_PIX_FMT_GBRP16,
+        AV_PIX_FMT_YUV420P,  AV_PIX_FMT_YUV422P,  AV_PIX_FMT_YUV444P,
+        AV_PIX_FMT_YUVJ420P, AV_PIX_FMT_YUVJ422P, AV_PIX_FMT_YUVJ444P,
+        AV_PIX_FMT_NONE
+    };
+    static const enum AVPixelFormat rgb_pix_fmts[] = {
         AV_PIX_FMT_RGB24, AV_PIX_FMT_BGR24,
         AV_PIX_FMT_RGBA,  AV_PIX_FMT_BGRA,
         AV_PIX_FMT_ABGR,  AV_PIX_FMT_ARGB,
@@ -514,371 +900,1766 @@ static int query_formats(AVFilterContext *ctx)
         AV_PIX_FMT_RGB0,  AV_PIX_FMT_BGR0,
         AV_PIX_FMT_NONE
     };
+    UnwarpVRContext *unwarpvr = ctx->priv;
+    int i;
+
+    if (unwarpvr->out_pix_fmt == AV_PIX_FMT_NONE) {
+        ff_set_common_formats(ctx, ff_make_format_list(pix_fmts));
+        return 0;
+    }
 
-    ff_set_common_formats(ctx, ff_make_format_list(pix_fmts));
+    ff_formats_ref(ff_make_format_list(rgb_pix_fmts), &ctx->inputs[0]->out_formats);
+    for (i = 0; i < ctx->nb_outputs; i++) {
+        AVFilterFormats *formats = NULL;
+        ff_add_format(&formats, unwarpvr->out_pix_fmt);
+        ff_formats_ref(formats, &ctx->outputs[i]->in_formats);
+    }
     return 0;
 }
 
-static int config_props(AVFilterLink *outlink)
+static const struct {
+    const char *name;
+    float kr, kb;
+    enum AVColorSpace colorspace;
+} color_matrices[] = {
+    { "bt709",     0.2126f, 0.0722f, AVCOL_SPC_BT709     },
+    { "fcc",       0.30f,   0.11f,   AVCOL_SPC_FCC       },
+    { "bt601",     0.299f,  0.114f,  AVCOL_SPC_BT470BG   },
+    { "bt470",     0.299f,  0.114f,  AVCOL_SPC_BT470BG   },
+    { "smpte170m", 0.299f,  0.114f,  AVCOL_SPC_SMPTE170M },
+    { "smpte240m", 0.212f,  0.087f,  AVCOL_SPC_SMPTE240M },
+};
+
+/**
+ * Set up the conversion of the remapped packed RGB to out_pix_fmt, with the
+ * matrices libswscale uses for out_color_matrix and out_range.
+ */
+static int init_conversion(AVFilterContext *ctx, AVFilterLink *inlink, AVFilterLink *outlink)
 {
-    AVFilterContext *ctx = outlink->src;
-    AVFilterLink *inlink = outlink->src->inputs[0];
-    enum AVPixelFormat outfmt = outlink->format;
     UnwarpVRContext *unwarpvr = ctx->priv;
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(inlink->format);
     const AVPixFmtDescriptor *out_desc = av_pix_fmt_desc_get(outlink->format);
-    int64_t w, h;
-    double var_values[VARS_NB], res;
-    char *expr;
-    int ret;
-    int factor_w, factor_h;
+    const char *matrix = unwarpvr->out_color_matrix;
+    float kr = 0.299f, kb = 0.114f, kg, y_scale, c_scale;
+    int full_range, i;
+
+    unwarpvr->conv_colorspace = AVCOL_SPC_UNSPECIFIED;
+    if (matrix && strcmp(matrix, "auto")) {
+        for (i = 0; i < FF_ARRAY_ELEMS(color_matrices); i++)
+            if (!strcmp(matrix, color_matrices[i].name))
+                break;
+        if (i == FF_ARRAY_ELEMS(color_matrices)) {
+            av_log(ctx, AV_LOG_ERROR, "Unsupported output color matrix '%s'\n", matrix);
+            return AVERROR(EINVAL);
+        }
+        kr = color_matrices[i].kr;
+        kb = color_matrices[i].kb;
+        unwarpvr->conv_colorspace = color_matrices[i].colorspace;
+    }
+    kg = 1.0f - kr - kb;
+
+    full_range = unwarpvr->out_range == AVCOL_RANGE_JPEG ||
+                 (unwarpvr->out_range == AVCOL_RANGE_UNSPECIFIED &&
+                  (outlink->format == AV_PIX_FMT_YUVJ420P || outlink->format == AV_PIX_FMT_YUVJ422P ||
+                   outlink->format == AV_PIX_FMT_YUVJ444P));
+    unwarpvr->conv_range = full_range ? AVCOL_RANGE_JPEG : AVCOL_RANGE_MPEG;
+    y_scale = (full_range ? 1.0f : 219.0f / 255) * (1 << CONV_BITS);
+    c_scale = (full_range ? 1.0f : 224.0f / 255) * (1 << CONV_BITS);
+
+    unwarpvr->conv_coeffs[0][0] = lrintf(kr * y_scale);
+    unwarpvr->conv_coeffs[0][1] = lrintf(kg * y_scale);
+    unwarpvr->conv_coeffs[0][2] = lrintf(kb * y_scale);
+    unwarpvr->conv_coeffs[1][0] = lrintf(-kr / (2 * (1 - kb)) * c_scale);
+    unwarpvr->conv_coeffs[1][1] = lrintf(-kg / (2 * (1 - kb)) * c_scale);
+    unwarpvr->conv_coeffs[1][2] = lrintf(0.5f * c_scale);
+    unwarpvr->conv_coeffs[2][0] = lrintf(0.5f * c_scale);
+    unwarpvr->conv_coeffs[2][1] = lrintf(-kg / (2 * (1 - kr)) * c_scale);
+    unwarpvr->conv_coeffs[2][2] = lrintf(-kb / (2 * (1 - kr)) * c_scale);
+    unwarpvr->conv_y_offset = ((full_range ? 0 : 16) << CONV_BITS) + (1 << (CONV_BITS - 1));
+
+    for (i = 0; i < 3; i++)
+        unwarpvr->rgb_offset[i] = desc->comp[i].offset_plus1 - 1;
+    unwarpvr->conv_hsub = out_desc->log2_chroma_w;
+    unwarpvr->conv_vsub = out_desc->log2_chroma_h;
+    unwarpvr->rgb_linesize = unwarpvr->planes[0].out_w * unwarpvr->planes[0].step;
 
-    var_values[VAR_IN_W]  = var_values[VAR_IW] = inlink->w;
-    var_values[VAR_IN_H]  = var_values[VAR_IH] = inlink->h;
-    var_values[VAR_OUT_W] = var_values[VAR_OW] = NAN;
-    var_values[VAR_OUT_H] = var_values[VAR_OH] = NAN;
-    var_values[VAR_A]     = (double) inlink->w / inlink->h;
-    var_values[VAR_SAR]   = inlink->sample_aspect_ratio.num ?
-        (double) inlink->sample_aspect_ratio.num / inlink->sample_aspect_ratio.den : 1;
-    var_values[VAR_DAR]   = var_values[VAR_A] * var_values[VAR_SAR];
-    var_values[VAR_HSUB]  = 1 << desc->log2_chroma_w;
-    var_values[VAR_VSUB]  = 1 << desc->log2_chroma_h;
-    var_values[VAR_OHSUB] = 1 << out_desc->log2_chroma_w;
-    var_values[VAR_OVSUB] = 1 << out_desc->log2_chroma_h;
+    return 0;
+}
 
-    /* evaluate width and height */
-    av_expr_parse_and_eval(&res, (expr = unwarpvr->w_expr),
-                           var_names, var_values,
-                           NULL, NULL, NULL, NULL, NULL, 0, ctx);
-    unwarpvr->w = var_values[VAR_OUT_W] = var_values[VAR_OW] = res;
-    if ((ret = av_expr_parse_and_eval(&res, (expr = unwarpvr->h_expr),
-                                      var_names, var_values,
-                                      NULL, NULL, NULL, NULL, NULL, 0, ctx)) < 0)
-        goto fail;
-    unwarpvr->h = var_values[VAR_OUT_H] = var_values[VAR_OH] = res;
-    /* evaluate again the width, as it may depend on the output height */
-    if ((ret = av_expr_parse_and_eval(&res, (expr = unwarpvr->w_expr),
-                                      var_names, var_values,
-                                      NULL, NULL, NULL, NULL, NULL, 0, ctx)) < 0)
-        goto fail;
-    unwarpvr->w = res;
+/**
+ * Byte offset in the input plane of a valid remap table entry.
+ */
+static av_always_inline ptrdiff_t resolve_entry(uint32_t entry, int linesize)
+{
+    return (ptrdiff_t)(entry >> UNWARPVR_MAP_X_BITS) * linesize + (entry & ((1 << UNWARPVR_MAP_X_BITS) - 1));
+}
 
-    w = unwarpvr->w;
-    h = unwarpvr->h;
+void ff_unwarpvr_remap_nearest_c(uint8_t *dst, const uint8_t *src, int linesize, const int32_t *map, int n, int fill)
+{
+    int j;
 
-    /* Check if it is requested that the result has to be divisible by a some
-     * factor (w or h = -n with n being the factor). */
-    factor_w = 1;
-    factor_h = 1;
-    if (w < -1) {
-        factor_w = -w;
+    // Invalid entries are -1: clamp them to offset 0 and select the fill value instead
+    for (j = 0; j < n; j++) {
+        const int invalid = map[j] >> 31;
+        const ptrdiff_t offset = resolve_entry(map[j] & ~invalid, linesize);
+        dst[j] = (src[offset] & ~invalid) | (fill & invalid);
     }
-    if (h < -1) {
-        factor_h = -h;
+}
+
+void ff_unwarpvr_remap_nearest16_c(uint8_t *dst, const uint8_t *src, int linesize, const int32_t *map, int n, int fill)
+{
+    int j;
+
+    for (j = 0; j < n; j++) {
+        const int invalid = map[j] >> 31;
+        const ptrdiff_t offset = resolve_entry(map[j] & ~invalid, linesize);
+        AV_WN16(dst + 2 * j, (AV_RN16(src + offset) & ~invalid) | (fill & invalid));
     }
+}
 
-    if (w < 0 && h < 0)
-        unwarpvr->w = unwarpvr->h = 0;
+void ff_unwarpvr_remap_nearest32_c(uint8_t *dst, const uint8_t *src, int linesize, const int32_t *map, int n, int fill)
+{
+    int j;
 
-    if (!(w = unwarpvr->w))
-        w = inlink->w;
-    if (!(h = unwarpvr->h))
-        h = inlink->h;
+    for (j = 0; j < n; j++) {
+        const int invalid = map[j] >> 31;
+        const ptrdiff_t offset = resolve_entry(map[j] & ~invalid, linesize);
+        AV_WN32(dst + 4 * j, (AV_RN32(src + offset) & ~invalid) | (fill & invalid));
+    }
+}
 
-    /* Make sure that the result is divisible by the factor we determined
-     * earlier. If no factor was set, it is nothing will happen as the default
-     * factor is 1 */
-    if (w < 0)
-        w = av_rescale(h, inlink->w, inlink->h * factor_w) * factor_w;
-    if (h < 0)
-        h = av_rescale(w, inlink->h, inlink->w * factor_h) * factor_h;
+static void remap_row_nearest(const UnwarpVRContext *unwarpvr, const UnwarpVRPlane *plane, uint8_t *dst,
+                              const uint8_t *src, int linesize, const int32_t *map, const uint16_t *frac, int n)
+{
+    unwarpvr->dsp.remap_nearest(dst, src, linesize, map, n, plane->fill);
+}
 
-    /* Note that force_original_aspect_ratio may overwrite the previous set
-     * dimensions so that it is not divisible by the set factors anymore. */
-    if (unwarpvr->force_original_aspect_ratio) {
-        int tmp_w = av_rescale(h, inlink->w, inlink->h);
-        int tmp_h = av_rescale(w, inlink->h, inlink->w);
+static void remap_row_nearest16(const UnwarpVRContext *unwarpvr, const UnwarpVRPlane *plane, uint8_t *dst,
+                                const uint8_t *src, int linesize, const int32_t *map, const uint16_t *frac, int n)
+{
+    unwarpvr->dsp.remap_nearest16(dst, src, linesize, map, n, plane->fill);
+}
 
-        if (unwarpvr->force_original_aspect_ratio == 1) {
-             w = FFMIN(tmp_w, w);
-             h = FFMIN(tmp_h, h);
-        } else {
-             w = FFMAX(tmp_w, w);
-             h = FFMAX(tmp_h, h);
-        }
-    }
+static void remap_row_nearest32(const UnwarpVRContext *unwarpvr, const UnwarpVRPlane *plane, uint8_t *dst,
+                                const uint8_t *src, int linesize, const int32_t *map, const uint16_t *frac, int n)
+{
+    unwarpvr->dsp.remap_nearest32(dst, src, linesize, map, n, plane->fill);
+}
 
-    if (w > INT_MAX || h > INT_MAX ||
-        (h * inlink->w) > INT_MAX  ||
-        (w * inlink->h) > INT_MAX)
-        av_log(ctx, AV_LOG_ERROR, "Rescaled value for width or height is too big.\n");
+/**
+ * Filtered remap of samples of type pixel. Sums of 16-bit bicubic taps need
+ * 64 bits; 8-bit ones fit in an int.
+ */
+#define DEFINE_REMAP_FILTERED(bits, pixel, sum_type)                                                  \
+static void remap_row_bilinear_ ## bits(const UnwarpVRContext *unwarpvr, const UnwarpVRPlane *plane,    \
+                                        uint8_t *dst_, const uint8_t *src, int linesize,                \
+                                        const int32_t *map, const uint16_t *frac, int n)                \
+{                                                                                                       \
+    const int step = plane->step;                                                                       \
+    pixel *dst = (pixel *)dst_;                                                                         \
+    int j;                                                                                              \
+                                                                                                        \
+    for (j = 0; j < n; j++) {                                                                           \
+        const uint8_t *s;                                                                               \
+        int fx, fy, top, bottom;                                                                        \
+                                                                                                        \
+        if (map[j] == -1) {                                                                             \
+            dst[j] = plane->fill;                                                                       \
+            continue;                                                                                   \
+        }                                                                                               \
+        s  = src + resolve_entry(map[j], linesize);                                                     \
+        fx = frac[j] & 0xFF;                                                                            \
+        fy = frac[j] >> 8;                                                                              \
+        top    = *(const pixel *)s              * (INTERP_FRAC_ONE - fx) +                              \
+                 *(const pixel *)(s + step)     * fx;                                                   \
+        bottom = *(const pixel *)(s + linesize) * (INTERP_FRAC_ONE - fx) +                              \
+                 *(const pixel *)(s + linesize + step) * fx;                                            \
+        dst[j] = (top * (INTERP_FRAC_ONE - fy) + bottom * fy + (1 << (2 * INTERP_FRAC_BITS - 1))) >>    \
+                 (2 * INTERP_FRAC_BITS);                                                                \
+    }                                                                                                   \
+}                                                                                                       \
+                                                                                                        \
+static void remap_row_bicubic_ ## bits(const UnwarpVRContext *unwarpvr, const UnwarpVRPlane *plane,     \
+                                       uint8_t *dst_, const uint8_t *src, int linesize,                 \
+                                       const int32_t *map, const uint16_t *frac, int n)                 \
+{                                                                                                       \
+    const int step = plane->step;                                                                       \
+    pixel *dst = (pixel *)dst_;                                                                         \
+    int j, k;                                                                                           \
+                                                                                                        \
+    for (j = 0; j < n; j++) {                                                                           \
+        const int16_t *cx, *cy;                                                                         \
+        const uint8_t *s;                                                                               \
+        sum_type sum = 0;                                                                               \
+                                                                                                        \
+        if (map[j] == -1) {                                                                             \
+            dst[j] = plane->fill;                                                                       \
+            continue;                                                                                   \
+        }                                                                                               \
+        s  = src + resolve_entry(map[j], linesize);                                                     \
+        cx = unwarpvr->cubic_coeffs[frac[j] & 0xFF];                                                    \
+        cy = unwarpvr->cubic_coeffs[frac[j] >> 8];                                                      \
+        for (k = 0; k < 4; k++, s += linesize) {                                                        \
+            int row = *(const pixel *)s              * cx[0] + *(const pixel *)(s + step)     * cx[1] + \
+                      *(const pixel *)(s + 2 * step) * cx[2] + *(const pixel *)(s + 3 * step) * cx[3];  \
+            sum += (sum_type)row * cy[k];                                                               \
+        }                                                                                               \
+        dst[j] = av_clip_uintp2((sum + (1 << (2 * CUBIC_COEF_BITS - 1))) >> (2 * CUBIC_COEF_BITS),      \
+                                plane->depth);                                                          \
+    }                                                                                                   \
+}
 
-    outlink->w = w;
-    outlink->h = h;
+DEFINE_REMAP_FILTERED(8,  uint8_t,  int)
+DEFINE_REMAP_FILTERED(16, uint16_t, int64_t)
 
-    /* TODO: make algorithm configurable */
-
-    unwarpvr->input_is_pal = desc->flags & AV_PIX_FMT_FLAG_PAL ||
-                             desc->flags & AV_PIX_FMT_FLAG_PSEUDOPAL;
-    if (outfmt == AV_PIX_FMT_PAL8) outfmt = AV_PIX_FMT_BGR8;
-    unwarpvr->output_is_pal = av_pix_fmt_desc_get(outfmt)->flags & AV_PIX_FMT_FLAG_PAL ||
-                              av_pix_fmt_desc_get(outfmt)->flags & AV_PIX_FMT_FLAG_PSEUDOPAL;
-
-    if (unwarpvr->sws)
-        sws_freeContext(unwarpvr->sws);
-    if (unwarpvr->isws[0])
-        sws_freeContext(unwarpvr->isws[0]);
-    if (unwarpvr->isws[1])
-        sws_freeContext(unwarpvr->isws[1]);
-    unwarpvr->isws[0] = unwarpvr->isws[1] = unwarpvr->sws = NULL;
-    if (inlink->w == outlink->w && inlink->h == outlink->h &&
-        inlink->format == outlink->format)
-        ;
-    else {
-        struct SwsContext **swscs[3] = { &unwarpvr->sws, &unwarpvr->isws[0], &unwarpvr->isws[1] };
-        int i;
+// Catmull-Rom (a = -0.5) weights of the four taps around each fractional position
+static av_cold void init_cubic_coeffs(int16_t coeffs[INTERP_FRAC_ONE + 1][4])
+{
+    int i;
+
+    for (i = 0; i <= INTERP_FRAC_ONE; i++) {
+        double t = i / (double)INTERP_FRAC_ONE;
+        double c[4];
+        c[0] = ((-0.5 * t + 1.0) * t - 0.5) * t;
+        c[1] = (1.5 * t - 2.5) * t * t + 1.0;
+        c[2] = ((-1.5 * t + 2.0) * t + 0.5) * t;
+        c[3] = (0.5 * t - 0.5) * t * t;
+        coeffs[i][0] = lrint(c[0] * (1 << CUBIC_COEF_BITS));
+        coeffs[i][2] = lrint(c[2] * (1 << CUBIC_COEF_BITS));
+        coeffs[i][3] = lrint(c[3] * (1 << CUBIC_COEF_BITS));
+        coeffs[i][1] = (1 << CUBIC_COEF_BITS) - coeffs[i][0] - coeffs[i][2] - coeffs[i][3];
+    }
+}
 
-        for (i = 0; i < 3; i++) {
-            struct SwsContext **s = swscs[i];
-            *s = sws_alloc_context();
-            if (!*s)
-                return AVERROR(ENOMEM);
+/**
+ * Compute the remap table entry of one output sample.
+ * x and y are the source position in samples of the plane relative to the
+ * top left corner of the eye's view, which starts eye_x samples into the
+ * input; offset is the byte offset of the component within a sample.
+ * Entries hold the source row and the byte offset within it, so the table
+ * does not depend on the linesize of the input frames.
+ * Samples whose source lies outside the view are set to -1 (black).
+ */
+static void set_map_entry(const UnwarpVRContext *unwarpvr, const UnwarpVRPlane *plane,
+                          int32_t *map, uint16_t *frac, float x, float y, int eye_x, int offset)
+{
+    const int eye_w = plane->eye_w;
+    const int in_h  = plane->h;
+    int srcj = (int)x;
+    int srci = (int)y;
+    int taps, margin, basex, basey;
+    float xc, yc;
+
+    if (srci < 0 || srcj < 0 || srci >= in_h || srcj >= eye_w) {
+        *map = -1;
+        return;
+    }
 
-            if (unwarpvr->opts) {
-                AVDictionaryEntry *e = NULL;
+    if (unwarpvr->interp == INTERP_NEAREST) {
+        *map = srci << UNWARPVR_MAP_X_BITS | ((eye_x + srcj) * plane->step + offset);
+        return;
+    }
 
-                while ((e = av_dict_get(unwarpvr->opts, "", e, AV_DICT_IGNORE_SUFFIX))) {
-                    if ((ret = av_opt_set(*s, e->key, e->value, 0)) < 0)
-                        return ret;
-                }
-            }
+    // Filtered modes interpolate between pixel centres. The positions are
+    // clamped so that the whole footprint stays within the eye's view.
+    taps   = unwarpvr->interp == INTERP_BICUBIC ? 4 : 2;
+    margin = taps / 2 - 1;
+    xc = av_clipf(x - 0.5f, margin, eye_w - 1 - margin);
+    yc = av_clipf(y - 0.5f, margin, in_h  - 1 - margin);
+    basex = FFMIN((int)xc, eye_w - taps + margin);
+    basey = FFMIN((int)yc, in_h  - taps + margin);
+    *frac =  lrintf((xc - basex) * INTERP_FRAC_ONE) |
+            (lrintf((yc - basey) * INTERP_FRAC_ONE) << 8);
+    *map  = (basey - margin) << UNWARPVR_MAP_X_BITS |
+            ((eye_x + basex - margin) * plane->step + offset);
+}
 
-            av_opt_set_int(*s, "srcw", inlink->w, 0);
-            av_opt_set_int(*s, "srch", inlink->h >> !!i, 0);
-            av_opt_set_int(*s, "src_format", inlink->format, 0);
-            av_opt_set_int(*s, "dstw", outlink->w, 0);
-            av_opt_set_int(*s, "dsth", outlink->h >> !!i, 0);
-            av_opt_set_int(*s, "dst_format", outfmt, 0);
-            av_opt_set_int(*s, "sws_flags", unwarpvr->flags, 0);
-
-            av_opt_set_int(*s, "src_h_chr_pos", unwarpvr->in_h_chr_pos, 0);
-            av_opt_set_int(*s, "src_v_chr_pos", unwarpvr->in_v_chr_pos, 0);
-            av_opt_set_int(*s, "dst_h_chr_pos", unwarpvr->out_h_chr_pos, 0);
-            av_opt_set_int(*s, "dst_v_chr_pos", unwarpvr->out_v_chr_pos, 0);
-
-            if ((ret = sws_init_context(*s, NULL, NULL)) < 0)
-                return ret;
-            if (!unwarpvr->interlaced)
-                break;
-        }
+static void set_compact_entry(UnwarpVRContext *unwarpvr, int i, int col, float x, float y)
+{
+    CompactMapEntry *e = &unwarpvr->compact_map[i * unwarpvr->planes[0].out_w + col];
+    float dx = x * (1 << COMPACT_FRAC_BITS) - unwarpvr->compact_cols[col].base_x;
+    float dy = y * (1 << COMPACT_FRAC_BITS) - unwarpvr->compact_rows[i].base_y;
+
+    // Also catches the NaN produced at the exact lens centre
+    if (!(fabsf(dx) < INT16_MAX && fabsf(dy) < INT16_MAX)) {
+        e->dx = INT16_MIN;
+        return;
     }
+    e->dx = lrintf(dx);
+    e->dy = lrintf(dy);
+}
 
-    if (inlink->sample_aspect_ratio.num){
-        outlink->sample_aspect_ratio = av_mul_q((AVRational){outlink->h * inlink->w, outlink->w * inlink->h}, inlink->sample_aspect_ratio);
-    } else
-        outlink->sample_aspect_ratio = inlink->sample_aspect_ratio;
+static float ca_ratio(const UnwarpVRContext *unwarpvr, int c, float rsq)
+{
+    const float *lut = unwarpvr->table->ca_ratio[c];
+    float pos = FFMIN(rsq * unwarpvr->table->ca_lut_scale, CA_LUT_SIZE);
+    int k = (int)pos;
 
-    av_log(ctx, AV_LOG_VERBOSE, "w:%d h:%d fmt:%s sar:%d/%d -> w:%d h:%d fmt:%s sar:%d/%d flags:0x%0x\n",
-           inlink->w, inlink->h, av_get_pix_fmt_name( inlink->format),
-           inlink->sample_aspect_ratio.num, inlink->sample_aspect_ratio.den,
-           outlink->w, outlink->h, av_get_pix_fmt_name(outlink->format),
-           outlink->sample_aspect_ratio.num, outlink->sample_aspect_ratio.den,
-           unwarpvr->flags);
+    return lut[k] + (lut[k + 1] - lut[k]) * (pos - k);
+}
 
-    // Initialize inv_cache
-    {
-        int i, j, eye_count;
-        float MetersPerTanAngleAtCenter;
-        float screenWidthMeters;
-        float screenHeightMeters;
-        float LensCenterXOffset; // For left eye, determined by physical parameters
-        float TanEyeAngleScaleX, TanEyeAngleScaleY, DevicePPDInCenterX, DevicePPDInCenterY;
-        enum DistortionEqnType Eqn = Distortion_CatmullRom10;
-        float K[11];
-        float MaxR = 1.0f;
-        float ChromaticAberration[4];
-        int DeviceResX, DeviceResY;
-        int channel;
-        int in_linesize;
-
-        // Create temporary input frame just so we can get its linesize
-        AVFrame* in = ff_get_video_buffer(inlink, inlink->w, inlink->h);
-        if (!in) {
-            av_frame_free(&in);
-            return AVERROR(ENOMEM);
+/**
+ * Decode one output row of the compact table into full remap table entries.
+ * This is what makes compact mode slow: the chromatic aberration ratio
+ * depends on the radius of each pixel, so every channel of every pixel
+ * needs its own lookup and float position; storing them would give up the
+ * memory compact mode saves.
+ */
+static void decode_compact_row(const UnwarpVRContext *unwarpvr, int i, int32_t *map, uint16_t *frac)
+{
+    const UnwarpVRPlane *plane = &unwarpvr->planes[0];
+    const CompactMapEntry *e = unwarpvr->compact_map + i * plane->out_w;
+    const CompactRow *row = &unwarpvr->compact_rows[i];
+    const float unit = 1.0f / (1 << COMPACT_FRAC_BITS);
+    uint16_t dummy[4];
+    int j, k;
+
+    for (j = 0; j < plane->out_w; j++, map += plane->nb_comp) {
+        const CompactColumn *col = &unwarpvr->compact_cols[j];
+        uint16_t *f = frac ? frac + j * plane->nb_comp : dummy;
+        float x, y, cx, cy, ratio[NUM_CHANNELS];
+        int eye_x;
+
+        if (col->base_x < 0 || e[j].dx == INT16_MIN) {
+            for (k = 0; k < plane->nb_comp; k++)
+                map[k] = -1;
+            continue;
         }
-        in_linesize = in->linesize[0];
-        av_frame_free(&in);
-
-        if (strcmp(unwarpvr->device, "RiftDK1") == 0) {
-            MetersPerTanAngleAtCenter = 0.0425f;
-            screenWidthMeters = 0.14976f;
-            screenHeightMeters = screenWidthMeters / (1280.0f / 800.0f);
-            LensCenterXOffset = 0.15197646600f;
-            DeviceResX = 1280; DeviceResY = 800;
-
-            if (strcmp(unwarpvr->sdkversion, "0.2.5c") == 0) {
-                const float K_DK1[] = { 1.0f, 0.212f, 0.24f, 0.0f };
-                const float ChromaticAberrationDK1[] = { 0.996f - 1.0f, -0.004f, 1.014f - 1.0f, 0.0f };
-                Eqn = Distortion_Poly4;
-                memmove(K, K_DK1, sizeof(K));
-                memmove(ChromaticAberration, ChromaticAberrationDK1, sizeof(ChromaticAberration));
-                MetersPerTanAngleAtCenter = 0.25f * screenWidthMeters; // Ensures TanEyeAngleScaleX = 1.0 to match 0.2.5c behavior
-            }
-            else if (strcmp(unwarpvr->sdkversion, "0.4.2") == 0) {
-                // Use minimum eye relief distortion for now, but should be adjusted with eye relief
-                const float K_DK1[] = { 1.0f, 1.06505f, 1.14725f, 1.2705f, 1.48f, 1.87f, 2.534f, 3.6f, 5.1f, 7.4f, 11.0f };
-                const float ChromaticAberrationDK1[] = { -0.006f, 0.0f, 0.014f, 0.0f };
-                memmove(K, K_DK1, sizeof(K));
-                MaxR = sqrt(1.8f);
-                // ChromaticAbberation does not vary by eye relief in DK1 in SDK 0.4.2
-                memmove(ChromaticAberration, ChromaticAberrationDK1, sizeof(ChromaticAberration));
-            }
-            else {
-                av_log(ctx, AV_LOG_ERROR, "Internal error: unhandled SDK version %s\n", unwarpvr->sdkversion);
-                return AVERROR(EINVAL);
-            }
+        x  = (col->base_x + e[j].dx) * unit;
+        y  = (row->base_y + e[j].dy) * unit;
+        cx = unwarpvr->table->compact_cx[col->eye];
+        cy = unwarpvr->table->compact_cy;
+        eye_x = unwarpvr->table->compact_eye_x[col->eye];
+        ratio[0] = ca_ratio(unwarpvr, 0, col->rsq + row->rsq);
+        ratio[1] = 1.0f;
+        ratio[2] = ca_ratio(unwarpvr, 1, col->rsq + row->rsq);
+        for (k = 0; k < plane->nb_comp; k++) {
+            const float r = ratio[plane->channel[k]];
+            set_map_entry(unwarpvr, plane, &map[k], &f[k], cx + (x - cx) * r, cy + (y - cy) * r,
+                          eye_x, k * plane->sample_size);
         }
-        else if (strcmp(unwarpvr->device, "RiftDK2") == 0) {
-            // Distortion varies by SDK version but never by cup type or eye relief (for DK2 in 0.4.2)
-            const float K_DK2[] = { 1.003f, 1.02f, 1.042f, 1.066f, 1.094f, 1.126f, 1.162f, 1.203f, 1.25f, 1.31f, 1.38f };
-            // ChromaticAbberation varies by eye relief and lerps between the following two arrays
-            const float ChromaticAberrationMin[] = { -0.0112f, -0.015f, 0.0187f, 0.015f };
-            const float ChromaticAberrationMax[] = { -0.015f, -0.02f, 0.025f, 0.02f };
-            memmove(K, K_DK2, sizeof(K));
-            for (i = 0; i < sizeof(ChromaticAberration) / sizeof(*ChromaticAberration); i++) {
-                ChromaticAberration[i] = ChromaticAberrationMin[i] + unwarpvr->eye_relief_dial / 10.0f * (ChromaticAberrationMax[i] - ChromaticAberrationMin[i]);
-            }
+    }
+}
+
+/**
+ * Expand output row i of a plane from the part stored in a symmetric table,
+ * sym_map and sym_frac.
+ */
+static void reflect_row(const UnwarpVRPlane *plane, int i, int32_t *map, uint16_t *frac,
+                        const int32_t *sym_map, const uint16_t *sym_frac)
+{
+    const int nb_comp = plane->nb_comp;
+    const int out_width_per_eye = plane->out_w / 2;
+    const int mirror_y = plane->mirror_y && i >= plane->sym_h;
+    const int row = mirror_y ? plane->out_h - i : i;
+    const int nb_direct = (plane->mirror_x ? out_width_per_eye : plane->out_w) * nb_comp;
+    const int32_t x_mask = (1 << UNWARPVR_MAP_X_BITS) - 1;
+    // Mirrored rows are reflect_y - y, computed in place in the upper bits
+    const int32_t y_base = plane->reflect_y << UNWARPVR_MAP_X_BITS;
+    int j, k;
+
+    sym_map += (size_t)row * plane->sym_w * nb_comp;
+    if (sym_frac)
+        sym_frac += (size_t)row * plane->sym_w * nb_comp;
+
+    // Columns read from the same column of the stored row
+    if (!mirror_y) {
+        memcpy(map, sym_map, nb_direct * sizeof(*map));
+        if (frac)
+            memcpy(frac, sym_frac, nb_direct * sizeof(*frac));
+    } else {
+        for (j = 0; j < nb_direct; j++) {
+            const int32_t e = sym_map[j];
+            map[j] = e < 0 ? -1 : (y_base - (e & ~x_mask)) | (e & x_mask);
+        }
+        if (frac) {
+            for (j = 0; j < nb_direct; j++)
+                frac[j] = ((INTERP_FRAC_ONE << 8) - (sym_frac[j] & 0xFF00)) | (sym_frac[j] & 0xFF);
+        }
+    }
+    if (!plane->mirror_x)
+        return;
+
+    // Right eye column j mirrors stored column out_width_per_eye - j
+    for (j = 0; j < out_width_per_eye; j++) {
+        const int32_t *src = sym_map + (out_width_per_eye - j) * nb_comp;
+        int32_t *dst = map + (out_width_per_eye + j) * nb_comp;
+
+        for (k = 0; k < nb_comp; k++) {
+            const int32_t e = src[k];
+            const int32_t y = mirror_y ? y_base - (e & ~x_mask) : e & ~x_mask;
+            dst[k] = e < 0 ? -1 : y | (plane->reflect_x[k] - (e & x_mask));
+        }
+        if (frac) {
+            const uint16_t *src_frac = sym_frac + (out_width_per_eye - j) * nb_comp;
+            uint16_t *dst_frac = frac + (out_width_per_eye + j) * nb_comp;
+
+            for (k = 0; k < nb_comp; k++) {
+                const int fy = src_frac[k] >> 8;
+                dst_frac[k] = (INTERP_FRAC_ONE - (src_frac[k] & 0xFF)) |
+                              (mirror_y ? INTERP_FRAC_ONE - fy : fy) << 8;
+            }
+        }
+    }
+    // The last column of an odd output width belongs to neither eye
+    for (k = 2 * out_width_per_eye * nb_comp; k < plane->out_w * nb_comp; k++)
+        map[k] = -1;
+}
+
+typedef struct BuildTableData {
+    struct UnwarpVRContext *unwarpvr;   ///< state the table is built for
+    const DeviceParams *dev;
+    const DistortionInvLUT *inv_lut; ///< per channel, unwarping only
+    int in_h, out_w, out_h;
+    int in_width_per_eye;
+    int nb_eyes;
+    int one_eye_multiplier;
+    int in_eye[NUM_EYES];
+    float lensCenterXOffsetEye[NUM_EYES];
+    float TanEyeAngleScaleX, TanEyeAngleScaleY;
+    float scale_in_width, scale_in_height;
+    float rsq_limit;            ///< largest squared tangent that can land in the input, other projections only
+    int32_t *sym_map;           ///< destination of the computed entries, laid out as a symmetric table
+    uint16_t *sym_frac;
+} BuildTableData;
+
+/**
+ * Turn the tangents (*tanx, *tany) a rectilinear view would give the output
+ * position (i, j) of an eye into those of the view direction of the
+ * projection. An equirectangular output keeps the angle per pixel of the
+ * rectilinear one at its centre; each face of a cubemap spans 90 degrees,
+ * laid out as right, left, up over down, front, back.
+ *
+ * @return 0 if the direction is behind the eye
+ */
+static int project_view(const UnwarpVRContext *unwarpvr, const BuildTableData *td,
+                        float i, float j, float *tanx, float *tany)
+{
+    if (unwarpvr->projection == PROJECTION_EQUIRECT) {
+        const float lon = *tanx, lat = *tany;
+
+        if (fabsf(lon) >= M_PI / 2 || fabsf(lat) >= M_PI / 2)
+            return 0;
+        *tanx = tanf(lon);
+        *tany = tanf(lat) / cosf(lon);
+    } else if (unwarpvr->projection == PROJECTION_CUBEMAP) {
+        const float face_w = td->out_w / 2 * td->one_eye_multiplier / 3.0f;
+        const float face_h = td->out_h / 2.0f;
+        const int col = FFMIN((int)(j / face_w), 2);
+        const int row = FFMIN((int)(i / face_h), 1);
+        const float a = -1.0f + 2.0f * (j - col * face_w) / face_w;
+        const float b = -1.0f + 2.0f * (i - row * face_h) / face_h;
+        float x, y, z;
+
+        // x to the right, y down and z forward
+        switch (row * 3 + col) {
+        case 0:  x =  1.0f; y =  b;    z = -a;    break;
+        case 1:  x = -1.0f; y =  b;    z =  a;    break;
+        case 2:  x =  a;    y = -1.0f; z =  b;    break;
+        case 3:  x =  a;    y =  1.0f; z = -b;    break;
+        case 4:  x =  a;    y =  b;    z =  1.0f; break;
+        default: x = -a;    y =  b;    z = -1.0f; break;
+        }
+        if (z <= 0.0f)
+            return 0;
+        *tanx = x / z;
+        *tany = y / z;
+    }
+    return 1;
+}
+
+/**
+ * Compute the source position of each channel for the output position (i, j)
+ * of an eye, in input pixels relative to the eye's view. i and j are in output
+ * pixels and may be fractional for subsampled chroma. rsq_x and rsq_y receive
+ * the horizontal and vertical terms of the squared radius.
+ *
+ * @return 0 if the position shows nothing of the input
+ */
+static int map_position(const UnwarpVRContext *unwarpvr, const BuildTableData *td, int eye_count,
+                         float i, float j, float x[NUM_CHANNELS], float y[NUM_CHANNELS],
+                         float *rsq_x, float *rsq_y)
+{
+    const DeviceParams *dev = td->dev;
+    const int one_eye_multiplier = td->one_eye_multiplier;
+    const float lensCenterXOffsetEye = td->lensCenterXOffsetEye[eye_count];
+    int channel;
+
+    if (!unwarpvr->forward_warp)
+    {
+        float ndcx_raw, ndcy_raw, ndcx, ndcy, rsq;
+
+        ndcx_raw = ((-1.0f + 2.0f * (j / (float)(td->out_w / 2 * one_eye_multiplier))) * one_eye_multiplier) / unwarpvr->scale_width;
+        ndcy_raw = (-1.0f + 2.0f * (i / (float)(td->out_h))) / unwarpvr->scale_height;
+        ndcx = ndcx_raw * ((float)td->out_w / dev->DeviceResX); // Scale so changing input/output resolution only affects cropping, not scaling
+        ndcy = ndcy_raw * ((float)td->out_h / dev->DeviceResY);
+        ndcx *= td->TanEyeAngleScaleX;
+        ndcy *= td->TanEyeAngleScaleY;
+        if (unwarpvr->projection != PROJECTION_RECTILINEAR &&
+            (!project_view(unwarpvr, td, i, j, &ndcx, &ndcy) ||
+             ndcx*ndcx + ndcy*ndcy > td->rsq_limit))
+            return 0;
+        rsq = ndcx*ndcx + ndcy*ndcy;
+        *rsq_x = ndcx*ndcx;
+        *rsq_y = ndcy*ndcy;
+        for (channel = 0; channel < NUM_CHANNELS; channel++) {
+            float ndcx_scaled, ndcy_scaled;
+            float scale = sqrt(distortion_inv_ratio(&td->inv_lut[channel], rsq));
+
+            ndcx_scaled = ndcx * scale;
+            ndcy_scaled = ndcy * scale;
+            ndcx_scaled /= td->TanEyeAngleScaleX;
+            ndcy_scaled /= td->TanEyeAngleScaleY;
+            x[channel] = ((ndcx_scaled + lensCenterXOffsetEye) * td->scale_in_width + 1.0f) / 2.0f * td->in_width_per_eye;
+            y[channel] = (ndcy_scaled * td->scale_in_height + 1.0f) / 2.0f * td->in_h;
+        }
+    }
+    else // if (unwarpvr->forward_warp)
+    {
+        float ndcx, ndcy, tanx_distorted, tany_distorted, rsq;
+        float scale[NUM_CHANNELS];
+
+        ndcx = ((-1.0f + 2.0f * j / (td->out_w / 2 * one_eye_multiplier)) * one_eye_multiplier) / unwarpvr->scale_width - lensCenterXOffsetEye;
+        ndcy = (-1.0f + 2.0f * i / td->out_h) / unwarpvr->scale_height;
+        tanx_distorted = ndcx * td->TanEyeAngleScaleX;
+        tany_distorted = ndcy * td->TanEyeAngleScaleY;
+        rsq = tanx_distorted*tanx_distorted + tany_distorted*tany_distorted;
+        *rsq_x = tanx_distorted*tanx_distorted;
+        *rsq_y = tany_distorted*tany_distorted;
+        scale[0] = DistortionFnScaleRadiusSquared(dev->Eqn, dev->K, dev->MaxR, dev->ChromaticAberration[0], dev->ChromaticAberration[1], rsq);
+        scale[1] = DistortionFnScaleRadiusSquared(dev->Eqn, dev->K, dev->MaxR, 0, 0, rsq);
+        scale[2] = DistortionFnScaleRadiusSquared(dev->Eqn, dev->K, dev->MaxR, dev->ChromaticAberration[2], dev->ChromaticAberration[3], rsq);
+        for (channel = 0; channel < NUM_CHANNELS; channel++) {
+            float tanx, tany, rt_ndcx, rt_ndcy;
+
+            tanx = tanx_distorted * scale[channel];
+            tany = tany_distorted * scale[channel];
+
+            rt_ndcx = tanx / td->TanEyeAngleScaleX;
+            rt_ndcy = tany / td->TanEyeAngleScaleY;
+
+            x[channel] = (rt_ndcx * td->scale_in_width / 2.0f * dev->DeviceResX / 2) + (td->in_width_per_eye / 2.0f);
+            y[channel] = (rt_ndcy * td->scale_in_height / 2.0f * dev->DeviceResY) + (td->in_h / 2.0f);
+        }
+    }
+    return 1;
+}
+
+/**
+ * Convert a position in input pixels to the sample grid of a plane.
+ * Pixel k covers [k, k + 1); chr_pos is the position of the first chroma
+ * sample on the luma grid, in luma samples.
+ */
+static float to_plane_pos(float pos, int sub, float chr_pos)
+{
+    if (!sub && !chr_pos)
+        return pos;
+    return (pos - 0.5f - chr_pos) / (1 << sub) + 0.5f;
+}
+
+/**
+ * Compute the remap table entries of a slice of rows of the symmetric table
+ * of each plane. Column out_w / 2 of a horizontally mirrored plane is still
+ * computed for the left eye: it is the mirror image of the right eye's first
+ * column.
+ */
+static int build_table_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    const BuildTableData *td = arg;
+    UnwarpVRContext *unwarpvr = td->unwarpvr;
+    const int out_width_per_eye = td->out_w / 2 * td->one_eye_multiplier;
+    int p, i, j, k;
+
+    for (p = 0; p < unwarpvr->nb_planes; p++) {
+        const UnwarpVRPlane *plane = &unwarpvr->planes[p];
+        const int slice_start = (plane->sym_h *  jobnr   ) / nb_jobs;
+        const int slice_end   = (plane->sym_h * (jobnr+1)) / nb_jobs;
+        const int row_entries = plane->sym_w * plane->nb_comp;
+
+        if (!unwarpvr->compact) {
+            for (k = slice_start * row_entries; k < slice_end * row_entries; k++) {
+                td->sym_map[plane->sym_offset + k] = -1;
+            }
+        }
+        for (i = slice_start; i < slice_end; i++) {
+            const float out_y = (i << plane->vsub) + plane->out_v_chr_pos;
+
+            for (j = 0; j < plane->sym_w; j++) {
+                float out_x = (j << plane->hsub) + plane->out_h_chr_pos;
+                float x[NUM_CHANNELS], y[NUM_CHANNELS], rsq_x, rsq_y;
+                int eye_count = td->nb_eyes > 1 && out_x >= td->out_w / 2 && !plane->mirror_x;
+                int eye_x = td->in_eye[eye_count] * plane->eye_w;
+
+                out_x -= eye_count * (td->out_w / 2);
+                // The last column of an odd output width belongs to neither eye
+                if (out_x >= out_width_per_eye && !plane->mirror_x)
+                    continue;
+                if (!map_position(unwarpvr, td, eye_count, out_y, out_x, x, y, &rsq_x, &rsq_y))
+                    continue;
+
+                if (unwarpvr->compact) {
+                    if (i == 0)
+                        unwarpvr->compact_cols[j].rsq = rsq_x;
+                    unwarpvr->compact_rows[i].rsq = rsq_y;
+                    set_compact_entry(unwarpvr, i, j, x[1], y[1]);
+                    continue;
+                }
+                for (k = 0; k < plane->nb_comp; k++) {
+                    const int channel = plane->channel[k];
+                    const size_t output_idx = plane->sym_offset + i * row_entries + j * plane->nb_comp + k;
+
+                    set_map_entry(unwarpvr, plane, &td->sym_map[output_idx],
+                                  td->sym_frac ? &td->sym_frac[output_idx] : NULL,
+                                  to_plane_pos(x[channel], plane->hsub, plane->in_h_chr_pos),
+                                  to_plane_pos(y[channel], plane->vsub, plane->in_v_chr_pos),
+                                  eye_x, k * plane->sample_size);
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Expand a slice of rows of a symmetric table into the full table.
+ */
+static int expand_table_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    const BuildTableData *td = arg;
+    UnwarpVRContext *unwarpvr = td->unwarpvr;
+    int p, i;
+
+    for (p = 0; p < unwarpvr->nb_planes; p++) {
+        const UnwarpVRPlane *plane = &unwarpvr->planes[p];
+        const int slice_start = (plane->out_h *  jobnr   ) / nb_jobs;
+        const int slice_end   = (plane->out_h * (jobnr+1)) / nb_jobs;
+        const size_t row_entries = (size_t)plane->out_w * plane->nb_comp;
+
+        for (i = slice_start; i < slice_end; i++) {
+            const size_t offset = plane->map_offset + i * row_entries;
+            reflect_row(plane, i, unwarpvr->inv_cache + offset,
+                        unwarpvr->inv_frac ? unwarpvr->inv_frac + offset : NULL,
+                        td->sym_map + plane->sym_offset,
+                        td->sym_frac ? td->sym_frac + plane->sym_offset : NULL);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Find the valid entries of each half of an output row.
+ */
+static void find_spans(const UnwarpVRPlane *plane, const int32_t *map, RowSpan *spans)
+{
+    const int bounds[3] = { 0, plane->out_w / 2 * plane->nb_comp, plane->out_w * plane->nb_comp };
+    int h;
+
+    for (h = 0; h < 2; h++) {
+        int start = bounds[h], end = bounds[h + 1];
+
+        while (start < end && map[start] < 0)
+            start++;
+        while (end > start && map[end - 1] < 0)
+            end--;
+        spans[h].start = start;
+        spans[h].end   = end;
+    }
+}
+
+static int find_spans_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    const BuildTableData *td = arg;
+    const UnwarpVRContext *unwarpvr = td->unwarpvr;
+    int p, i;
+
+    for (p = 0; p < unwarpvr->nb_planes; p++) {
+        const UnwarpVRPlane *plane = &unwarpvr->planes[p];
+        const int slice_start = (plane->out_h *  jobnr   ) / nb_jobs;
+        const int slice_end   = (plane->out_h * (jobnr+1)) / nb_jobs;
+        const int jlimit = plane->out_w * plane->nb_comp;
+        int32_t *row_map = unwarpvr->row_map ? unwarpvr->row_map + jobnr * unwarpvr->row_buf_size : NULL;
+
+        for (i = slice_start; i < slice_end; i++) {
+            const int32_t *map = row_map;
+
+            if (unwarpvr->compact)
+                decode_compact_row(unwarpvr, i, row_map, NULL);
+            else if (unwarpvr->symmetric)
+                reflect_row(plane, i, row_map, NULL, unwarpvr->inv_cache + plane->map_offset, NULL);
+            else
+                map = unwarpvr->inv_cache + plane->map_offset + (size_t)i * jlimit;
+            find_spans(plane, map, unwarpvr->spans[plane->spans_offset + i]);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Fill in the arrays of a freshly allocated remap table for the options and
+ * planes in unwarpvr, running the slices of the work through execute.
+ */
+static int build_table(AVFilterContext *ctx, UnwarpVRContext *unwarpvr, UnwarpVRTable *t,
+                       AVFilterLink *inlink, avfilter_execute_func *execute)
+{
+    const int out_w = unwarpvr->planes[0].out_w;
+    const int out_h = unwarpvr->planes[0].out_h;
+    int i, j, eye_count;
+    DeviceParams dev;
+    DistortionInvLUT *inv_lut = NULL;
+    BuildTableData td;
+    float TanEyeAngleScaleX, TanEyeAngleScaleY, DevicePPDInCenterX, DevicePPDInCenterY;
+    int one_eye_multiplier = unwarpvr->left_eye_only ? 2 : 1;
+    int in_width_per_eye = unwarpvr->mono_input ? inlink->w : inlink->w / 2;
+    int channel, ret;
+    float scale_in_width  = unwarpvr->scale_in_width;
+    float scale_in_height = unwarpvr->scale_in_height;
+
+    if ((ret = get_device_params(ctx, unwarpvr->device, unwarpvr->sdkversion,
+                                 unwarpvr->eye_relief_dial, &dev)) < 0)
+        return ret;
+
+    if (!unwarpvr->correct_ca)
+        memset(dev.ChromaticAberration, 0, sizeof(dev.ChromaticAberration));
+
+    DevicePPDInCenterX = dev.MetersPerTanAngleAtCenter / dev.screenWidthMeters * dev.DeviceResX;
+    DevicePPDInCenterY = dev.MetersPerTanAngleAtCenter / dev.screenHeightMeters * dev.DeviceResY;
+
+    if (unwarpvr->ppd != 0.0f) {
+        scale_in_width *= (unwarpvr->ppd * 53.1301f) / DevicePPDInCenterX; // 53.1301 deg = tan(0.5) - (tan-0.5)
+        scale_in_height *= (unwarpvr->ppd * 53.1301f) / DevicePPDInCenterY;
+    }
+
+    // As computed in CalculateDistortionRenderDesc() distortion.TanEyeAngleScale in OVR_Stereo.cpp
+    TanEyeAngleScaleX = 0.25f * dev.screenWidthMeters / dev.MetersPerTanAngleAtCenter;
+    TanEyeAngleScaleY = 0.5f * dev.screenHeightMeters / dev.MetersPerTanAngleAtCenter;
+
+    if (!unwarpvr->forward_warp) {
+        // ndcx and ndcy in build_table_slice() are linear in j and i, and largest at j = 0 and i = 0
+        float ndcx_max = one_eye_multiplier / unwarpvr->scale_width * ((float)out_w / dev.DeviceResX) * TanEyeAngleScaleX;
+        float ndcy_max = 1.0f / unwarpvr->scale_height * ((float)out_h / dev.DeviceResY) * TanEyeAngleScaleY;
+        float rsq_max = ndcx_max * ndcx_max + ndcy_max * ndcy_max;
+        const float *ca = dev.ChromaticAberration;
+
+        if (unwarpvr->projection != PROJECTION_RECTILINEAR) {
+            // Other projections can look in any direction, so the table
+            // covers the directions that land in the input: the distorted
+            // tangents at its corner furthest from the lens centre, clamped
+            // to the range DistortionFnScaleRadiusSquaredInv() searches
+            float tanx_max = TanEyeAngleScaleX * (1.0f / fabsf(scale_in_width) + fabsf(dev.LensCenterXOffset));
+            float tany_max = TanEyeAngleScaleY / fabsf(scale_in_height);
+            float d = FFMIN(tanx_max * tanx_max + tany_max * tany_max, 10.0f);
+
+            rsq_max = 0.0f;
+            for (channel = 0; channel < NUM_CHANNELS; channel++) {
+                float s = DistortionFnScaleRadiusSquared(dev.Eqn, dev.K, dev.MaxR, channel == 1 ? 0 : ca[channel],
+                                                         channel == 1 ? 0 : ca[channel + 1], d);
+                rsq_max = FFMAX(rsq_max, s * s * d);
+            }
+        }
+        td.rsq_limit = rsq_max;
+
+        inv_lut = av_malloc_array(NUM_CHANNELS, sizeof(*inv_lut));
+        if (!inv_lut)
+            return AVERROR(ENOMEM);
+        init_distortion_inv_lut(&inv_lut[0], dev.Eqn, dev.K, dev.MaxR, ca[0], ca[1], rsq_max);
+        init_distortion_inv_lut(&inv_lut[1], dev.Eqn, dev.K, dev.MaxR, 0, 0, rsq_max);
+        init_distortion_inv_lut(&inv_lut[2], dev.Eqn, dev.K, dev.MaxR, ca[2], ca[3], rsq_max);
+    }
+
+    if (unwarpvr->compact) {
+        for (i = 0; i < out_w; i++)
+            unwarpvr->compact_cols[i].base_x = -1;
+        for (i = 0; i < out_h; i++)
+            unwarpvr->compact_rows[i].base_y = lrintf(i * (float)inlink->h / out_h * (1 << COMPACT_FRAC_BITS));
+    }
+
+    td.unwarpvr = unwarpvr;
+    td.dev = &dev;
+    td.inv_lut = inv_lut;
+    td.in_h = inlink->h;
+    td.out_w = out_w;
+    td.out_h = out_h;
+    td.in_width_per_eye = in_width_per_eye;
+    td.one_eye_multiplier = one_eye_multiplier;
+    td.TanEyeAngleScaleX = TanEyeAngleScaleX;
+    td.TanEyeAngleScaleY = TanEyeAngleScaleY;
+    td.scale_in_width = scale_in_width;
+    td.scale_in_height = scale_in_height;
+
+    for (eye_count = 0; eye_count < NUM_EYES; eye_count++) {
+        float lensCenterXOffsetEye;
+        int in_eye = eye_count;
+        int out_eye = eye_count;
+        if (unwarpvr->left_eye_only && eye_count > 0)
+            break;
+        if (unwarpvr->swap_eyes)
+            in_eye = 1 - in_eye;
+        if (unwarpvr->mono_input)
+            in_eye = 0;
+        lensCenterXOffsetEye = ((!unwarpvr->forward_warp && in_eye) || (unwarpvr->forward_warp && out_eye)) ? -dev.LensCenterXOffset : dev.LensCenterXOffset;
+
+        if (unwarpvr->compact) {
+            int out_width_per_eye = out_w / 2 * one_eye_multiplier;
+            for (j = 0; j < out_width_per_eye; j++) {
+                CompactColumn *col = &unwarpvr->compact_cols[eye_count*out_w / 2 + j];
+                col->base_x = lrintf(j * (float)in_width_per_eye / out_width_per_eye * (1 << COMPACT_FRAC_BITS));
+                col->eye    = eye_count;
+            }
+            t->compact_eye_x[eye_count] = in_eye * in_width_per_eye;
+            t->compact_cx[eye_count] = unwarpvr->forward_warp ? in_width_per_eye / 2.0f :
+                (lensCenterXOffsetEye * scale_in_width + 1.0f) / 2.0f * in_width_per_eye;
+            t->compact_cy = inlink->h / 2.0f;
+        }
+
+        td.in_eye[eye_count] = in_eye;
+        td.lensCenterXOffsetEye[eye_count] = lensCenterXOffsetEye;
+    }
+    td.nb_eyes = eye_count;
+
+    // The full table is expanded from a symmetric one, so that both give
+    // the same output
+    td.sym_map  = unwarpvr->inv_cache;
+    td.sym_frac = unwarpvr->inv_frac;
+    if (!unwarpvr->compact && !unwarpvr->symmetric && unwarpvr->nb_sym_entries < unwarpvr->nb_entries) {
+        td.sym_map = av_malloc_array(unwarpvr->nb_sym_entries, sizeof(*td.sym_map));
+        td.sym_frac = NULL;
+        if (unwarpvr->inv_frac)
+            td.sym_frac = av_malloc_array(unwarpvr->nb_sym_entries, sizeof(*td.sym_frac));
+        if (!td.sym_map || (unwarpvr->inv_frac && !td.sym_frac)) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+    }
+
+    execute(ctx, build_table_slice, &td, NULL, unwarpvr->nb_slices);
+    if (td.sym_map != unwarpvr->inv_cache)
+        execute(ctx, expand_table_slice, &td, NULL, unwarpvr->nb_slices);
+
+    if (unwarpvr->compact) {
+        float rsq_max = 0.0f, rsq_max_y = 0.0f;
+        for (i = 0; i < out_w; i++)
+            if (unwarpvr->compact_cols[i].base_x >= 0)
+                rsq_max = FFMAX(rsq_max, unwarpvr->compact_cols[i].rsq);
+        for (i = 0; i < out_h; i++)
+            rsq_max_y = FFMAX(rsq_max_y, unwarpvr->compact_rows[i].rsq);
+        rsq_max += rsq_max_y;
+        t->ca_lut_scale = rsq_max > 0.0f ? CA_LUT_SIZE / rsq_max : 0.0f;
+        for (i = 1; i <= CA_LUT_SIZE; i++) {
+            float rsq = i * rsq_max / CA_LUT_SIZE;
+            for (channel = 0; channel < 2; channel++) {
+                float ca0 = dev.ChromaticAberration[2 * channel], ca1 = dev.ChromaticAberration[2 * channel + 1];
+                if (!unwarpvr->forward_warp)
+                    t->ca_ratio[channel][i] = sqrt(distortion_inv_ratio(&inv_lut[2 * channel], rsq) /
+                                                   distortion_inv_ratio(&inv_lut[1], rsq));
+                else
+                    t->ca_ratio[channel][i] = DistortionFnScaleRadiusSquared(dev.Eqn, dev.K, dev.MaxR, ca0, ca1, rsq) /
+                                              DistortionFnScaleRadiusSquared(dev.Eqn, dev.K, dev.MaxR, 0, 0, rsq);
+            }
+        }
+        for (channel = 0; channel < 2; channel++) {
+            t->ca_ratio[channel][0] = t->ca_ratio[channel][1];
+            t->ca_ratio[channel][CA_LUT_SIZE + 1] = t->ca_ratio[channel][CA_LUT_SIZE];
+        }
+    }
+
+    execute(ctx, find_spans_slice, &td, NULL, unwarpvr->nb_slices);
+
+end:
+    if (td.sym_map != unwarpvr->inv_cache) {
+        av_free(td.sym_map);
+        av_free(td.sym_frac);
+    }
+    av_free(inv_lut);
+    return ret;
+}
+
+static void setup_table_pointers(UnwarpVRContext *unwarpvr, UnwarpVRTable *t)
+{
+    uint8_t *base = (uint8_t *)t;
+
+    if (!t) {
+        unwarpvr->table        = NULL;
+        unwarpvr->inv_cache    = NULL;
+        unwarpvr->inv_frac     = NULL;
+        unwarpvr->compact_map  = NULL;
+        unwarpvr->compact_cols = NULL;
+        unwarpvr->compact_rows = NULL;
+        unwarpvr->spans        = NULL;
+        return;
+    }
+    unwarpvr->table        = t;
+    unwarpvr->inv_cache    = t->inv_cache_offset    ? (int32_t *)        (base + t->inv_cache_offset)    : NULL;
+    unwarpvr->inv_frac     = t->inv_frac_offset     ? (uint16_t *)       (base + t->inv_frac_offset)     : NULL;
+    unwarpvr->compact_map  = t->compact_map_offset  ? (CompactMapEntry *)(base + t->compact_map_offset)  : NULL;
+    unwarpvr->compact_cols = t->compact_cols_offset ? (CompactColumn *)  (base + t->compact_cols_offset) : NULL;
+    unwarpvr->compact_rows = t->compact_rows_offset ? (CompactRow *)     (base + t->compact_rows_offset) : NULL;
+    unwarpvr->spans        = (RowSpan (*)[2])(base + t->spans_offset);
+}
+
+/**
+ * Fill in the size and array offsets of a table for key.
+ */
+static void table_layout(UnwarpVRTable *t, const UnwarpVRTableKey *key,
+                         size_t nb_entries, size_t nb_rows)
+{
+    const size_t nb_pixels = (size_t)key->out_w * key->out_h;
+    size_t size = FFALIGN(sizeof(UnwarpVRTable), TABLE_ALIGN);
+
+    t->inv_cache_offset    = 0;
+    t->inv_frac_offset     = 0;
+    t->compact_map_offset  = 0;
+    t->compact_cols_offset = 0;
+    t->compact_rows_offset = 0;
+
+#define ADD_ARRAY(offset, nb, type) \
+    do {                            \
+        t->offset = size;           \
+        size     += FFALIGN((nb) * sizeof(type), TABLE_ALIGN); \
+    } while (0)
+    if (key->compact) {
+        ADD_ARRAY(compact_map_offset,  nb_pixels,  CompactMapEntry);
+        ADD_ARRAY(compact_cols_offset, key->out_w, CompactColumn);
+        ADD_ARRAY(compact_rows_offset, key->out_h, CompactRow);
+    } else {
+        ADD_ARRAY(inv_cache_offset, nb_entries, int32_t);
+        if (key->interp != INTERP_NEAREST)
+            ADD_ARRAY(inv_frac_offset, nb_entries, uint16_t);
+    }
+    ADD_ARRAY(spans_offset, 2 * nb_rows, RowSpan);
+#undef ADD_ARRAY
+    t->size = size;
+}
+
+static AVBufferRef *alloc_table(const UnwarpVRTableKey *key, size_t nb_entries, size_t nb_rows)
+{
+    UnwarpVRTable layout, *t;
+    AVBufferRef *buf;
+
+    table_layout(&layout, key, nb_entries, nb_rows);
+    buf = av_buffer_allocz(layout.size);
+    if (!buf)
+        return NULL;
+    t = (UnwarpVRTable *)buf->data;
+    t->magic   = TABLE_MAGIC;
+    t->version = TABLE_VERSION;
+    t->size    = layout.size;
+    t->key     = *key;
+    t->inv_cache_offset    = layout.inv_cache_offset;
+    t->inv_frac_offset     = layout.inv_frac_offset;
+    t->compact_map_offset  = layout.compact_map_offset;
+    t->compact_cols_offset = layout.compact_cols_offset;
+    t->compact_rows_offset = layout.compact_rows_offset;
+    t->spans_offset        = layout.spans_offset;
+    return buf;
+}
+
+static uint32_t table_checksum(const UnwarpVRTable *t)
+{
+    const uint8_t *p   = (const uint8_t *)&t->key;
+    const uint8_t *end = (const uint8_t *)t + t->size;
+    unsigned long checksum = 1;
+
+    // av_adler32_update() takes an unsigned int length
+    while (p < end) {
+        unsigned len = FFMIN(end - p, 1 << 30);
+        checksum = av_adler32_update(checksum, p, len);
+        p += len;
+    }
+    return checksum;
+}
+
+/* Tables shared between all filter instances of the process. Each entry
+ * holds a reference, which is dropped when no filter uses it any more.
+ * The lock only protects the list: a table is built outside of it, with a
+ * placeholder entry telling identical instances to wait for the result. */
+typedef struct TableCacheEntry {
+    UnwarpVRTableKey key;
+    AVBufferRef *buf;           ///< NULL while the table is being built
+} TableCacheEntry;
+
+#if HAVE_PTHREADS
+static pthread_mutex_t table_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  table_cache_cond  = PTHREAD_COND_INITIALIZER;
+#endif
+static TableCacheEntry **table_cache;
+static int nb_table_cache;
+
+static void table_cache_lock(void)
+{
+#if HAVE_PTHREADS
+    pthread_mutex_lock(&table_cache_mutex);
+#endif
+}
+
+static void table_cache_unlock(void)
+{
+#if HAVE_PTHREADS
+    pthread_mutex_unlock(&table_cache_mutex);
+#endif
+}
+
+/**
+ * Wait until a table being built by someone else is done. Must be called
+ * with the lock held.
+ */
+static void table_cache_wait(void)
+{
+#if HAVE_PTHREADS
+    pthread_cond_wait(&table_cache_cond, &table_cache_mutex);
+#else
+    // Without threads nothing can be building while we look
+    av_assert0(0);
+#endif
+}
+
+static TableCacheEntry *table_cache_find(const UnwarpVRTableKey *key)
+{
+    int i;
+
+    for (i = 0; i < nb_table_cache; i++)
+        if (!memcmp(&table_cache[i]->key, key, sizeof(*key)))
+            return table_cache[i];
+    return NULL;
+}
+
+static void table_cache_remove(TableCacheEntry *entry)
+{
+    int i;
+
+    for (i = 0; i < nb_table_cache; i++) {
+        if (table_cache[i] == entry) {
+            av_buffer_unref(&entry->buf);
+            av_free(entry);
+            table_cache[i] = table_cache[--nb_table_cache];
+            if (!nb_table_cache)
+                av_freep(&table_cache);
+            return;
+        }
+    }
+}
+
+/**
+ * Fill in the placeholder entry with buf, or drop it if buf is NULL, and
+ * wake up anyone waiting for it.
+ */
+static void table_cache_finish(TableCacheEntry *entry, AVBufferRef *buf)
+{
+    table_cache_lock();
+    if (!buf || !(entry->buf = av_buffer_ref(buf)))
+        table_cache_remove(entry);
+#if HAVE_PTHREADS
+    pthread_cond_broadcast(&table_cache_cond);
+#endif
+    table_cache_unlock();
+}
+
+static void release_table(UnwarpVRContext *unwarpvr)
+{
+    int i;
+
+    if (!unwarpvr->table_ref)
+        return;
+
+    table_cache_lock();
+    for (i = 0; i < nb_table_cache; i++) {
+        TableCacheEntry *entry = table_cache[i];
+        if (entry->buf && entry->buf->buffer == unwarpvr->table_ref->buffer) {
+            if (av_buffer_get_ref_count(entry->buf) <= 2)
+                table_cache_remove(entry);
+            break;
+        }
+    }
+    av_buffer_unref(&unwarpvr->table_ref);
+    table_cache_unlock();
+
+    setup_table_pointers(unwarpvr, NULL);
+}
+
+static void table_unmap(void *opaque, uint8_t *data)
+{
+    av_file_unmap(data, ((UnwarpVRTable *)data)->size);
+}
+
+/**
+ * Map a table saved by table_save(). Only tables with exactly the layout
+ * alloc_table() would give key and an intact checksum are accepted, the
+ * offsets and map entries of anything else cannot be trusted.
+ */
+static AVBufferRef *table_load(AVFilterContext *ctx, const char *path, const UnwarpVRTableKey *key,
+                               size_t nb_entries, size_t nb_rows)
+{
+    const UnwarpVRTable *t;
+    UnwarpVRTable layout;
+    AVBufferRef *buf;
+    uint8_t *data;
+    size_t size;
+    FILE *f;
+
+    // av_file_map() complains loudly about missing files, which is the normal first run case
+    if (!(f = fopen(path, "rb")))
+        return NULL;
+    fclose(f);
+
+    if (av_file_map(path, &data, &size, 0, ctx) < 0)
+        return NULL;
+    t = (const UnwarpVRTable *)data;
+    table_layout(&layout, key, nb_entries, nb_rows);
+    if (size < sizeof(*t) || t->magic != TABLE_MAGIC || t->version != TABLE_VERSION ||
+        t->size != size || memcmp(&t->key, key, sizeof(*key)) ||
+        t->size                != layout.size                ||
+        t->inv_cache_offset    != layout.inv_cache_offset    ||
+        t->inv_frac_offset     != layout.inv_frac_offset     ||
+        t->compact_map_offset  != layout.compact_map_offset  ||
+        t->compact_cols_offset != layout.compact_cols_offset ||
+        t->compact_rows_offset != layout.compact_rows_offset ||
+        t->spans_offset        != layout.spans_offset        ||
+        t->checksum != table_checksum(t)) {
+        av_log(ctx, AV_LOG_VERBOSE, "Remap table in %s does not match, rebuilding it\n", path);
+        av_file_unmap(data, size);
+        return NULL;
+    }
+
+    buf = av_buffer_create(data, size, table_unmap, NULL, AV_BUFFER_FLAG_READONLY);
+    if (!buf)
+        av_file_unmap(data, size);
+    return buf;
+}
+
+static void table_save(AVFilterContext *ctx, const char *path, const UnwarpVRTable *t)
+{
+    // Write to a temporary file first so concurrent processes never map a partial table
+    char *tmp = av_asprintf("%s.%08x.tmp", path, av_get_random_seed());
+    FILE *f;
+    int err;
+
+    if (!tmp)
+        return;
+    f = fopen(tmp, "wb");
+    if (!f) {
+        av_log(ctx, AV_LOG_WARNING, "Cannot write remap table to %s\n", tmp);
+        av_free(tmp);
+        return;
+    }
+    err = fwrite(t, 1, t->size, f) != t->size;
+    err |= fclose(f) != 0;
+    if (err || rename(tmp, path)) {
+        av_log(ctx, AV_LOG_WARNING, "Cannot write remap table to %s\n", path);
+        remove(tmp);
+    }
+    av_free(tmp);
+}
+
+static void fill_table_key(const UnwarpVRContext *unwarpvr, AVFilterLink *inlink, UnwarpVRTableKey *key)
+{
+    memset(key, 0, sizeof(*key));
+    av_strlcpy(key->device,     unwarpvr->device,     sizeof(key->device));
+    av_strlcpy(key->sdkversion, unwarpvr->sdkversion, sizeof(key->sdkversion));
+    key->format          = inlink->format;
+    key->in_w            = inlink->w;
+    key->in_h            = inlink->h;
+    key->out_w           = unwarpvr->planes[0].out_w;
+    key->out_h           = unwarpvr->planes[0].out_h;
+    key->in_h_chr_pos    = unwarpvr->in_h_chr_pos;
+    key->in_v_chr_pos    = unwarpvr->in_v_chr_pos;
+    key->out_h_chr_pos   = unwarpvr->out_h_chr_pos;
+    key->out_v_chr_pos   = unwarpvr->out_v_chr_pos;
+    key->swap_eyes       = unwarpvr->swap_eyes;
+    key->left_eye_only   = unwarpvr->left_eye_only;
+    key->mono_input      = unwarpvr->mono_input;
+    key->forward_warp    = unwarpvr->forward_warp;
+    key->eye_relief_dial = unwarpvr->eye_relief_dial;
+    key->interp          = unwarpvr->interp;
+    key->compact         = unwarpvr->compact;
+    key->symmetric       = unwarpvr->symmetric;
+    key->correct_ca      = unwarpvr->correct_ca;
+    key->projection      = unwarpvr->projection;
+    key->scale_width     = unwarpvr->scale_width;
+    key->scale_height    = unwarpvr->scale_height;
+    key->scale_in_width  = unwarpvr->scale_in_width;
+    key->scale_in_height = unwarpvr->scale_in_height;
+    key->ppd             = unwarpvr->ppd;
+}
+
+/**
+ * Get a reference to the remap table for the options and planes in unwarpvr,
+ * reusing one from another instance or from the map_cache file if possible.
+ * unwarpvr's table pointers are left pointing at the new table on success.
+ */
+static int get_table(AVFilterContext *ctx, UnwarpVRContext *unwarpvr, AVFilterLink *inlink,
+                     avfilter_execute_func *execute, AVBufferRef **pbuf)
+{
+    UnwarpVRTableKey key;
+    TableCacheEntry *entry;
+    AVBufferRef *buf = NULL;
+    int ret = 0;
+
+    fill_table_key(unwarpvr, inlink, &key);
+
+    table_cache_lock();
+    while ((entry = table_cache_find(&key)) && !entry->buf)
+        table_cache_wait();
+    if (entry) {
+        buf = av_buffer_ref(entry->buf);
+        entry = NULL;
+        if (!buf)
+            ret = AVERROR(ENOMEM);
+    } else if (!(entry = av_mallocz(sizeof(*entry)))) {
+        ret = AVERROR(ENOMEM);
+    } else {
+        entry->key = key;
+        if ((ret = av_dynarray_add_nofree(&table_cache, &nb_table_cache, entry)) < 0)
+            av_freep(&entry);
+    }
+    table_cache_unlock();
+    if (ret < 0)
+        goto end;
+
+    if (!entry) {
+        av_log(ctx, AV_LOG_VERBOSE, "Sharing remap table with another instance\n");
+    } else {
+        // Built without the lock, identical instances wait for the placeholder entry
+        if (unwarpvr->map_cache && (buf = table_load(ctx, unwarpvr->map_cache, &key,
+                                                           unwarpvr->nb_entries, unwarpvr->nb_rows)))
+            av_log(ctx, AV_LOG_VERBOSE, "Loaded remap table from %s\n", unwarpvr->map_cache);
+        if (!buf) {
+            buf = alloc_table(&key, unwarpvr->nb_entries, unwarpvr->nb_rows);
+            if (!buf) {
+                ret = AVERROR(ENOMEM);
+                goto end;
+            }
+            setup_table_pointers(unwarpvr, (UnwarpVRTable *)buf->data);
+            if ((ret = build_table(ctx, unwarpvr, (UnwarpVRTable *)buf->data, inlink, execute)) < 0) {
+                av_buffer_unref(&buf);
+                goto end;
+            }
+            ((UnwarpVRTable *)buf->data)->checksum = table_checksum((UnwarpVRTable *)buf->data);
+            if (unwarpvr->map_cache)
+                table_save(ctx, unwarpvr->map_cache, (UnwarpVRTable *)buf->data);
+        }
+    }
+    setup_table_pointers(unwarpvr, (UnwarpVRTable *)buf->data);
+    av_log(ctx, AV_LOG_VERBOSE, "Remap table: %d bytes\n", buf->size);
+    *pbuf = buf;
+
+end:
+    if (entry)
+        table_cache_finish(entry, buf);
+    if (ret < 0)
+        setup_table_pointers(unwarpvr, NULL);
+    return ret;
+}
+
+/**
+ * Point the filter at a remap table for the current link configuration.
+ */
+static av_cold int init_table(AVFilterContext *ctx, AVFilterLink *inlink)
+{
+    UnwarpVRContext *unwarpvr = ctx->priv;
+    UnwarpVRTableKey key;
+
+    // Each output link configures the filter again, keep the table if it still fits
+    fill_table_key(unwarpvr, inlink, &key);
+    if (unwarpvr->table && !memcmp(&unwarpvr->table->key, &key, sizeof(key)))
+        return 0;
+
+    release_table(unwarpvr);
+    return get_table(ctx, unwarpvr, inlink, ctx->internal->execute, &unwarpvr->table_ref);
+}
+
+/**
+ * Forget the last remapped frame, so that the next one is remapped.
+ */
+static void reset_static(UnwarpVRContext *unwarpvr)
+{
+    av_frame_free(&unwarpvr->prev_in);
+    av_frame_free(&unwarpvr->prev_out[0]);
+    av_frame_free(&unwarpvr->prev_out[1]);
+}
+
+#if HAVE_PTHREADS
+static int execute_serial(AVFilterContext *ctx, avfilter_action_func *func, void *arg,
+                          int *ret, int nb_jobs)
+{
+    int i;
+
+    for (i = 0; i < nb_jobs; i++) {
+        int r = func(ctx, arg, i, nb_jobs);
+        if (ret)
+            ret[i] = r;
+    }
+    return 0;
+}
+
+static void *rebuild_thread(void *arg)
+{
+    AVFilterContext *ctx = arg;
+    UnwarpVRContext *unwarpvr = ctx->priv;
+    AVBufferRef *buf = NULL;
+
+    // The slice threads are busy with frames, so the helper builds on its own
+    unwarpvr->rebuild_ret = get_table(ctx, unwarpvr->rebuild_ctx, ctx->inputs[0], execute_serial, &buf);
+    unwarpvr->rebuilt_table = buf;
+    avpriv_atomic_int_set(&unwarpvr->rebuild_done, 1);
+    return NULL;
+}
+
+/**
+ * Start building the table for the current options on a helper thread.
+ * The build works on a private copy of the filter state, so the filter keeps
+ * remapping frames with the old table meanwhile.
+ */
+static int start_rebuild(AVFilterContext *ctx)
+{
+    UnwarpVRContext *unwarpvr = ctx->priv;
+    UnwarpVRContext *s;
+    int ret;
+
+    s = av_malloc(sizeof(*s));
+    if (!s)
+        return AVERROR(ENOMEM);
+    *s = *unwarpvr;
+    s->table_ref    = NULL;
+    s->nb_slices    = 1;
+    s->row_buf_size = (size_t)s->planes[0].out_w * s->planes[0].nb_comp;
+    s->row_map      = NULL;
+    s->row_frac     = NULL;
+    setup_table_pointers(s, NULL);
+    if (s->compact || s->symmetric) {
+        s->row_map = av_malloc_array(s->row_buf_size, sizeof(*s->row_map));
+        if (!s->row_map) {
+            av_free(s);
+            return AVERROR(ENOMEM);
+        }
+    }
+
+    unwarpvr->rebuild_ctx     = s;
+    unwarpvr->rebuilt_table   = NULL;
+    unwarpvr->rebuild_done    = 0;
+    unwarpvr->rebuild_pending = 0;
+    if ((ret = pthread_create(&unwarpvr->rebuild_thread, NULL, rebuild_thread, ctx))) {
+        av_free(s->row_map);
+        av_freep(&unwarpvr->rebuild_ctx);
+        return AVERROR(ret);
+    }
+    unwarpvr->rebuild_running = 1;
+    return 0;
+}
+
+/**
+ * Reap the helper thread once its table is ready, or wait for it if wait is
+ * set. The new table is returned in *buf, or NULL if there is none yet.
+ */
+static int join_rebuild(AVFilterContext *ctx, int wait, AVBufferRef **buf)
+{
+    UnwarpVRContext *unwarpvr = ctx->priv;
+    int ret;
+
+    *buf = NULL;
+    if (!unwarpvr->rebuild_running ||
+        (!wait && !avpriv_atomic_int_get(&unwarpvr->rebuild_done)))
+        return 0;
+
+    pthread_join(unwarpvr->rebuild_thread, NULL);
+    unwarpvr->rebuild_running = 0;
+    av_free(unwarpvr->rebuild_ctx->row_map);
+    av_freep(&unwarpvr->rebuild_ctx);
+    ret = unwarpvr->rebuild_ret;
+    *buf = unwarpvr->rebuilt_table;
+    unwarpvr->rebuilt_table = NULL;
+    return ret;
+}
+
+/**
+ * Switch to a rebuilt table between two frames, and start a rebuild if the
+ * options changed since the last one was started. With rebuild_wait, the
+ * rebuild is finished before the frame, which then uses the new table.
+ */
+static void update_table(AVFilterContext *ctx)
+{
+    UnwarpVRContext *unwarpvr = ctx->priv;
+    AVBufferRef *buf;
+    int ret;
+
+    do {
+        if ((ret = join_rebuild(ctx, unwarpvr->rebuild_wait, &buf)) < 0)
+            av_log(ctx, AV_LOG_ERROR, "Failed to rebuild the remap table, keeping the old one\n");
+        if (buf) {
+            reset_static(unwarpvr);
+            release_table(unwarpvr);
+            unwarpvr->table_ref = buf;
+            setup_table_pointers(unwarpvr, (UnwarpVRTable *)buf->data);
+            av_log(ctx, AV_LOG_VERBOSE, "Switched to the rebuilt remap table\n");
+        }
+        if (unwarpvr->rebuild_pending && !unwarpvr->rebuild_running &&
+            (ret = start_rebuild(ctx)) < 0)
+            av_log(ctx, AV_LOG_ERROR, "Failed to start rebuilding the remap table\n");
+    } while (unwarpvr->rebuild_wait && unwarpvr->rebuild_running);
+}
+
+static void cancel_rebuild(AVFilterContext *ctx)
+{
+    UnwarpVRContext *unwarpvr = ctx->priv;
+    AVBufferRef *buf;
+
+    join_rebuild(ctx, 1, &buf);
+    av_buffer_unref(&buf);
+    unwarpvr->rebuild_pending = 0;
+}
+#endif
+
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    UnwarpVRContext *unwarpvr = ctx->priv;
+    int i;
+
+#if HAVE_PTHREADS
+    cancel_rebuild(ctx);
+#endif
+    av_dict_free(&unwarpvr->opts);
+    release_table(unwarpvr);
+    av_freep(&unwarpvr->row_map);
+    av_freep(&unwarpvr->row_frac);
+    av_freep(&unwarpvr->rgb_buf);
+    reset_static(unwarpvr);
+    av_freep(&unwarpvr->slice_changed);
+    if (unwarpvr->skip_static)
+        av_log(ctx, AV_LOG_VERBOSE, "%"PRId64" of %"PRId64" frames were static\n",
+               unwarpvr->nb_static, unwarpvr->nb_frames);
+    for (i = 0; i < ctx->nb_outputs; i++)
+        av_freep(&ctx->output_pads[i].name);
+}
+
+// Same default siting as libswscale: chroma centred between the luma samples it covers
+static float chroma_pos(int pos, int sub)
+{
+    if (pos == -1 || pos <= -513)
+        pos = (128 << sub) - 128;
+    return pos / 256.0f;
+}
+
+/**
+ * Find out which parts of a plane's table mirror other parts.
+ * The two eyes are mirror images if their lens centres are offset in opposite
+ * directions: when unwarping, that is unless both are read from the same
+ * input view. Subsampled planes are not symmetric on the sample grid.
+ */
+static void init_plane_symmetry(const UnwarpVRContext *unwarpvr, UnwarpVRPlane *plane)
+{
+    const int taps = unwarpvr->interp == INTERP_BICUBIC  ? 4 :
+                     unwarpvr->interp == INTERP_BILINEAR ? 2 : 1;
+    const int in_eye[NUM_EYES] = { unwarpvr->mono_input ? 0 :  unwarpvr->swap_eyes,
+                                   unwarpvr->mono_input ? 0 : !unwarpvr->swap_eyes };
+    int k;
+
+    plane->mirror_x = !unwarpvr->compact && !unwarpvr->left_eye_only && plane->out_w >= 2 &&
+                      unwarpvr->projection != PROJECTION_CUBEMAP &&
+                      (unwarpvr->forward_warp || !unwarpvr->mono_input) &&
+                      !plane->hsub && !plane->in_h_chr_pos && !plane->out_h_chr_pos;
+    plane->mirror_y = !unwarpvr->compact && unwarpvr->projection != PROJECTION_CUBEMAP &&
+                      !plane->vsub && !plane->in_v_chr_pos && !plane->out_v_chr_pos;
+    plane->sym_w = plane->mirror_x ? plane->out_w / 2 + 1 : plane->out_w;
+    plane->sym_h = plane->mirror_y ? plane->out_h / 2 + 1 : plane->out_h;
+
+    // Entries point at the top left tap, so that is what gets reflected
+    for (k = 0; k < plane->nb_comp; k++)
+        plane->reflect_x[k] = ((in_eye[0] + in_eye[1] + 1) * plane->eye_w - taps) * plane->step +
+                              2 * k * plane->sample_size;
+    plane->reflect_y = plane->h - taps;
+}
+
+static void init_planes(UnwarpVRContext *unwarpvr, AVFilterLink *inlink, AVFilterLink *outlink)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(inlink->format);
+    const int in_width_per_eye = unwarpvr->mono_input ? inlink->w : inlink->w / 2;
+    const int depth = desc->comp[0].depth_minus1 + 1;
+    const int sample_size = depth > 8 ? 2 : 1;
+    size_t map_offset = 0, sym_offset = 0, nb_rows = 0;
+    int p;
+
+    memset(unwarpvr->planes, 0, sizeof(unwarpvr->planes));
+    if (!(desc->flags & AV_PIX_FMT_FLAG_PLANAR)) {
+        UnwarpVRPlane *plane = &unwarpvr->planes[0];
+        const int pixel_size = desc->comp[0].step_minus1 + 1;
+
+        plane->step        = pixel_size;
+        plane->sample_size = sample_size;
+        plane->depth       = depth;
+        plane->eye_w       = in_width_per_eye;
+        plane->h           = inlink->h;
+        plane->out_w       = outlink->w;
+        plane->out_h       = outlink->h;
+        // Without chromatic aberration all bytes of a 32-bit pixel come from
+        // the same source pixel, so it can be copied as a whole
+        plane->whole_pixel = pixel_size == 4 && unwarpvr->interp == INTERP_NEAREST &&
+                             !unwarpvr->correct_ca;
+        plane->nb_comp     = plane->whole_pixel ? 1 : pixel_size / sample_size;
+        // Alpha and padding follow green; pixels outside the view are
+        // transparent black
+        for (p = 0; p < 4; p++)
+            plane->channel[p] = 1;
+        if (!plane->whole_pixel) {
+            for (p = 0; p < NUM_CHANNELS; p++)
+                plane->channel[(desc->comp[p].offset_plus1 - 1) / sample_size] = p;
+        }
+        unwarpvr->nb_planes = 1;
+    } else {
+        // Chromatic aberration is corrected per plane: luma follows green, Cb
+        // blue and Cr red. Planar RGB is stored in the same G, B, R order.
+        for (p = 0; p < 3; p++) {
+            static const int channels[3] = { 1, 2, 0 };
+            UnwarpVRPlane *plane = &unwarpvr->planes[p];
+            const int hsub = p ? desc->log2_chroma_w : 0;
+            const int vsub = p ? desc->log2_chroma_h : 0;
+
+            plane->step        = sample_size;
+            plane->sample_size = sample_size;
+            plane->depth       = depth;
+            plane->eye_w       = in_width_per_eye >> hsub;
+            plane->h           = FF_CEIL_RSHIFT(inlink->h, vsub);
+            plane->out_w       = FF_CEIL_RSHIFT(outlink->w, hsub);
+            plane->out_h       = FF_CEIL_RSHIFT(outlink->h, vsub);
+            plane->nb_comp     = 1;
+            plane->channel[0]  = channels[p];
+            plane->hsub        = hsub;
+            plane->vsub        = vsub;
+            if (p) {
+                plane->in_h_chr_pos  = chroma_pos(unwarpvr->in_h_chr_pos,  hsub);
+                plane->in_v_chr_pos  = chroma_pos(unwarpvr->in_v_chr_pos,  vsub);
+                plane->out_h_chr_pos = chroma_pos(unwarpvr->out_h_chr_pos, hsub);
+                plane->out_v_chr_pos = chroma_pos(unwarpvr->out_v_chr_pos, vsub);
+            }
+            if (desc->flags & AV_PIX_FMT_FLAG_RGB)
+                plane->fill = 0;
+            else if (p)
+                plane->fill = 128;
+            else
+                plane->fill = inlink->format == AV_PIX_FMT_YUVJ420P ||
+                              inlink->format == AV_PIX_FMT_YUVJ422P ||
+                              inlink->format == AV_PIX_FMT_YUVJ444P ? 0 : 16;
+        }
+        unwarpvr->nb_planes = 3;
+    }
+
+    for (p = 0; p < unwarpvr->nb_planes; p++) {
+        UnwarpVRPlane *plane = &unwarpvr->planes[p];
+        const size_t nb_entries = (size_t)plane->out_w * plane->out_h * plane->nb_comp;
+
+        init_plane_symmetry(unwarpvr, plane);
+        plane->map_offset   = map_offset;
+        plane->sym_offset   = sym_offset;
+        plane->spans_offset = nb_rows;
+        nb_rows += plane->out_h;
+        map_offset += unwarpvr->symmetric ? (size_t)plane->sym_w * plane->sym_h * plane->nb_comp : nb_entries;
+        sym_offset += (size_t)plane->sym_w * plane->sym_h * plane->nb_comp;
+    }
+    unwarpvr->nb_entries     = map_offset;
+    unwarpvr->nb_sym_entries = sym_offset;
+    unwarpvr->nb_rows        = nb_rows;
+}
+
+/**
+ * Configure the remap of the full stereo view, whose size outlink receives.
+ */
+static int config_remap(AVFilterLink *outlink)
+{
+    AVFilterContext *ctx = outlink->src;
+    AVFilterLink *inlink = outlink->src->inputs[0];
+    UnwarpVRContext *unwarpvr = ctx->priv;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(inlink->format);
+    const AVPixFmtDescriptor *out_desc = av_pix_fmt_desc_get(outlink->format);
+    int64_t w, h;
+    double var_values[VARS_NB], res;
+    char *expr;
+    int i, ret;
+    int factor_w, factor_h;
+
+    var_values[VAR_IN_W]  = var_values[VAR_IW] = inlink->w;
+    var_values[VAR_IN_H]  = var_values[VAR_IH] = inlink->h;
+    var_values[VAR_OUT_W] = var_values[VAR_OW] = NAN;
+    var_values[VAR_OUT_H] = var_values[VAR_OH] = NAN;
+    var_values[VAR_A]     = (double) inlink->w / inlink->h;
+    var_values[VAR_SAR]   = inlink->sample_aspect_ratio.num ?
+        (double) inlink->sample_aspect_ratio.num / inlink->sample_aspect_ratio.den : 1;
+    var_values[VAR_DAR]   = var_values[VAR_A] * var_values[VAR_SAR];
+    var_values[VAR_HSUB]  = 1 << desc->log2_chroma_w;
+    var_values[VAR_VSUB]  = 1 << desc->log2_chroma_h;
+    var_values[VAR_OHSUB] = 1 << out_desc->log2_chroma_w;
+    var_values[VAR_OVSUB] = 1 << out_desc->log2_chroma_h;
+
+    /* evaluate width and height */
+    av_expr_parse_and_eval(&res, (expr = unwarpvr->w_expr),
+                           var_names, var_values,
+                           NULL, NULL, NULL, NULL, NULL, 0, ctx);
+    unwarpvr->w = var_values[VAR_OUT_W] = var_values[VAR_OW] = res;
+    if ((ret = av_expr_parse_and_eval(&res, (expr = unwarpvr->h_expr),
+                                      var_names, var_values,
+                                      NULL, NULL, NULL, NULL, NULL, 0, ctx)) < 0)
+        goto fail;
+    unwarpvr->h = var_values[VAR_OUT_H] = var_values[VAR_OH] = res;
+    /* evaluate again the width, as it may depend on the output height */
+    if ((ret = av_expr_parse_and_eval(&res, (expr = unwarpvr->w_expr),
+                                      var_names, var_values,
+                                      NULL, NULL, NULL, NULL, NULL, 0, ctx)) < 0)
+        goto fail;
+    unwarpvr->w = res;
+
+    w = unwarpvr->w;
+    h = unwarpvr->h;
+
+    /* Check if it is requested that the result has to be divisible by a some
+     * factor (w or h = -n with n being the factor). */
+    factor_w = 1;
+    factor_h = 1;
+    if (w < -1) {
+        factor_w = -w;
+    }
+    if (h < -1) {
+        factor_h = -h;
+    }
+
+    if (w < 0 && h < 0)
+        unwarpvr->w = unwarpvr->h = 0;
+
+    if (!(w = unwarpvr->w))
+        w = inlink->w;
+    if (!(h = unwarpvr->h))
+        h = inlink->h;
 
-            MetersPerTanAngleAtCenter = 0.036f;
-            screenWidthMeters = 0.12576f;
-            screenHeightMeters = 0.07074f;
-            LensCenterXOffset = -0.00986003876f;
-            DeviceResX = 1920; DeviceResY = 1080;
-        }
-        else {
-            av_log(ctx, AV_LOG_ERROR,
-                "Invalid device specified. Valid options: RiftDK1, RiftDK2\n");
-            return AVERROR(EINVAL);
-        }
+    /* Make sure that the result is divisible by the factor we determined
+     * earlier. If no factor was set, it is nothing will happen as the default
+     * factor is 1 */
+    if (w < 0)
+        w = av_rescale(h, inlink->w, inlink->h * factor_w) * factor_w;
+    if (h < 0)
+        h = av_rescale(w, inlink->h, inlink->w * factor_h) * factor_h;
 
-        DevicePPDInCenterX = MetersPerTanAngleAtCenter / screenWidthMeters * DeviceResX;
-        DevicePPDInCenterY = MetersPerTanAngleAtCenter / screenHeightMeters * DeviceResY;
+    /* Note that force_original_aspect_ratio may overwrite the previous set
+     * dimensions so that it is not divisible by the set factors anymore. */
+    if (unwarpvr->force_original_aspect_ratio) {
+        int tmp_w = av_rescale(h, inlink->w, inlink->h);
+        int tmp_h = av_rescale(w, inlink->h, inlink->w);
 
-        if (unwarpvr->ppd != 0.0f) {
-            unwarpvr->scale_in_width *= (unwarpvr->ppd * 53.1301f) / DevicePPDInCenterX; // 53.1301 deg = tan(0.5) - (tan-0.5)
-            unwarpvr->scale_in_height *= (unwarpvr->ppd * 53.1301f) / DevicePPDInCenterY;
+        if (unwarpvr->force_original_aspect_ratio == 1) {
+             w = FFMIN(tmp_w, w);
+             h = FFMIN(tmp_h, h);
+        } else {
+             w = FFMAX(tmp_w, w);
+             h = FFMAX(tmp_h, h);
         }
+    }
 
-        // As computed in CalculateDistortionRenderDesc() distortion.TanEyeAngleScale in OVR_Stereo.cpp
-        TanEyeAngleScaleX = 0.25f * screenWidthMeters / MetersPerTanAngleAtCenter;
-        TanEyeAngleScaleY = 0.5f * screenHeightMeters / MetersPerTanAngleAtCenter;
+    if (w > INT_MAX || h > INT_MAX ||
+        (h * inlink->w) > INT_MAX  ||
+        (w * inlink->h) > INT_MAX)
+        av_log(ctx, AV_LOG_ERROR, "Rescaled value for width or height is too big.\n");
 
-        unwarpvr->inv_cache = av_malloc_array(outlink->w * outlink->h * NUM_CHANNELS, sizeof(int));
-        if (!unwarpvr->inv_cache)
-        {
-            av_log(ctx, AV_LOG_ERROR, "unwarpvr: Out of memory allocating cache\n");
+    outlink->w = w;
+    outlink->h = h;
+
+    if (inlink->sample_aspect_ratio.num){
+        outlink->sample_aspect_ratio = av_mul_q((AVRational){outlink->h * inlink->w, outlink->w * inlink->h}, inlink->sample_aspect_ratio);
+    } else
+        outlink->sample_aspect_ratio = inlink->sample_aspect_ratio;
+
+    av_log(ctx, AV_LOG_VERBOSE, "w:%d h:%d fmt:%s sar:%d/%d -> w:%d h:%d fmt:%s sar:%d/%d flags:0x%0x\n",
+           inlink->w, inlink->h, av_get_pix_fmt_name( inlink->format),
+           inlink->sample_aspect_ratio.num, inlink->sample_aspect_ratio.den,
+           outlink->w, outlink->h, av_get_pix_fmt_name(outlink->format),
+           outlink->sample_aspect_ratio.num, outlink->sample_aspect_ratio.den,
+           unwarpvr->flags);
+
+    init_planes(unwarpvr, inlink, outlink);
+
+    if (unwarpvr->compact && unwarpvr->nb_planes > 1) {
+        av_log(ctx, AV_LOG_ERROR, "The compact table only supports packed RGB input\n");
+        return AVERROR(EINVAL);
+    }
+    if (unwarpvr->compact && unwarpvr->symmetric) {
+        av_log(ctx, AV_LOG_ERROR, "The compact table cannot be symmetric\n");
+        return AVERROR(EINVAL);
+    }
+
+    switch (unwarpvr->interp) {
+    case INTERP_NEAREST:
+        if (unwarpvr->planes[0].whole_pixel)
+            unwarpvr->remap_row = remap_row_nearest32;
+        else
+            unwarpvr->remap_row = unwarpvr->planes[0].sample_size == 2 ? remap_row_nearest16 : remap_row_nearest;
+        break;
+    case INTERP_BILINEAR:
+        unwarpvr->remap_row = unwarpvr->planes[0].sample_size == 2 ? remap_row_bilinear_16 : remap_row_bilinear_8;
+        break;
+    case INTERP_BICUBIC:
+        unwarpvr->remap_row = unwarpvr->planes[0].sample_size == 2 ? remap_row_bicubic_16 : remap_row_bicubic_8;
+        init_cubic_coeffs(unwarpvr->cubic_coeffs);
+        break;
+    }
+    for (i = 0; i < unwarpvr->nb_planes; i++) {
+        const UnwarpVRPlane *plane = &unwarpvr->planes[i];
+        if (FF_CEIL_RSHIFT(inlink->w, plane->hsub) * plane->step > 1 << UNWARPVR_MAP_X_BITS ||
+            plane->h > INT32_MAX >> UNWARPVR_MAP_X_BITS) {
+            av_log(ctx, AV_LOG_ERROR, "Input is too large\n");
             return AVERROR(EINVAL);
         }
-        for (i = 0; i < outlink->h * outlink->w * NUM_CHANNELS; i++) {
-            unwarpvr->inv_cache[i] = -1;
+        if (unwarpvr->interp != INTERP_NEAREST &&
+            (unwarpvr->planes[i].h < 4 || unwarpvr->planes[i].eye_w < 4)) {
+            av_log(ctx, AV_LOG_ERROR, "Input is too small for interpolation\n");
+            return AVERROR(EINVAL);
         }
-        for (eye_count = 0; eye_count < NUM_EYES; eye_count++) {
-            int one_eye_multiplier = unwarpvr->left_eye_only ? 2 : 1;
-            float lensCenterXOffsetEye;
-            int in_eye = eye_count;
-            int out_eye = eye_count;
-            int in_width_per_eye = unwarpvr->mono_input ? inlink->w : inlink->w / 2;
-            if (unwarpvr->left_eye_only && eye_count > 0)
-                break;
-            if (unwarpvr->swap_eyes)
-                in_eye = 1 - in_eye;
-            if (unwarpvr->mono_input)
-                in_eye = 0;
-            lensCenterXOffsetEye = ((!unwarpvr->forward_warp && in_eye) || (unwarpvr->forward_warp && out_eye)) ? -LensCenterXOffset : LensCenterXOffset;
+    }
 
-            if (!unwarpvr->forward_warp)
-            {
-                for (i = 0; i < outlink->h; i++) {
-                    for (j = 0; j < outlink->w / 2 * one_eye_multiplier; j++) {
-                        float ndcx_raw, ndcy_raw, ndcx, ndcy, rsq;
-                        float new_rsq[NUM_CHANNELS];
-
-                        ndcx_raw = ((-1.0f + 2.0f * (j / (float)(outlink->w / 2 * one_eye_multiplier))) * one_eye_multiplier) / unwarpvr->scale_width;
-                        ndcy_raw = (-1.0f + 2.0f * (i / (float)(outlink->h))) / unwarpvr->scale_height;
-                        ndcx = ndcx_raw * ((float)outlink->w / DeviceResX); // Scale so changing input/output resolution only affects cropping, not scaling
-                        ndcy = ndcy_raw * ((float)outlink->h / DeviceResY);
-                        ndcx *= TanEyeAngleScaleX;
-                        ndcy *= TanEyeAngleScaleY;
-                        rsq = ndcx*ndcx + ndcy*ndcy;
-                        new_rsq[0] = DistortionFnScaleRadiusSquaredInv(Eqn, K, MaxR, ChromaticAberration[0], ChromaticAberration[1], rsq);
-                        new_rsq[1] = DistortionFnScaleRadiusSquaredInv(Eqn, K, MaxR, 0, 0, rsq);
-                        new_rsq[2] = DistortionFnScaleRadiusSquaredInv(Eqn, K, MaxR, ChromaticAberration[2], ChromaticAberration[3], rsq);
-                        for (channel = 0; channel < NUM_CHANNELS; channel++) {
-                            float x, y;
-                            int srcj, srci;
-                            float ndcx_scaled, ndcy_scaled;
-                            float scale = sqrt(new_rsq[channel] / rsq);
-                            int output_idx = (i*outlink->w + eye_count*outlink->w / 2 + j)*NUM_CHANNELS + channel;
-
-                            ndcx_scaled = ndcx * scale;
-                            ndcy_scaled = ndcy * scale;
-                            ndcx_scaled /= TanEyeAngleScaleX;
-                            ndcy_scaled /= TanEyeAngleScaleY;
-                            x = ((ndcx_scaled + lensCenterXOffsetEye) * unwarpvr->scale_in_width + 1.0f) / 2.0f * in_width_per_eye;
-                            y = (ndcy_scaled * unwarpvr->scale_in_height + 1.0f) / 2.0f * inlink->h;
-
-                            srcj = (int)x;
-                            srci = (int)y;
-
-                            if (srci >= 0 && srcj >= 0 && srci < inlink->h && srcj < in_width_per_eye)
-                                unwarpvr->inv_cache[output_idx] = (srci*in_linesize) + (in_eye * in_width_per_eye + srcj)*NUM_CHANNELS + channel;
-                        }
-                    }
-                }
-            }
-            else // if (unwarpvr->forward_warp)
-            {
-                for (i = 0; i < outlink->h; i++) {
-                    for (j = 0; j < outlink->w / 2 * one_eye_multiplier; j++) {
-                        float ndcx, ndcy, tanx_distorted, tany_distorted, rsq;
-                        float scale[NUM_CHANNELS];
-
-                        ndcx = ((-1.0f + 2.0f * j / (outlink->w / 2 * one_eye_multiplier)) * one_eye_multiplier) / unwarpvr->scale_width - lensCenterXOffsetEye;
-                        ndcy = (-1.0f + 2.0f * i / outlink->h) / unwarpvr->scale_height;
-                        tanx_distorted = ndcx * TanEyeAngleScaleX;
-                        tany_distorted = ndcy * TanEyeAngleScaleY;
-                        rsq = tanx_distorted*tanx_distorted + tany_distorted*tany_distorted;
-                        scale[0] = DistortionFnScaleRadiusSquared(Eqn, K, MaxR, ChromaticAberration[0], ChromaticAberration[1], rsq);
-                        scale[1] = DistortionFnScaleRadiusSquared(Eqn, K, MaxR, 0, 0, rsq);
-                        scale[2] = DistortionFnScaleRadiusSquared(Eqn, K, MaxR, ChromaticAberration[2], ChromaticAberration[3], rsq);
-                        for (channel = 0; channel < NUM_CHANNELS; channel++) {
-                            float x, y;
-                            int srcj, srci;
-                            float tanx, tany, rt_ndcx, rt_ndcy;
-                            int output_idx = (i*outlink->w + eye_count*outlink->w / 2 + j)*NUM_CHANNELS + channel;
-
-                            tanx = tanx_distorted * scale[channel];
-                            tany = tany_distorted * scale[channel];
-
-                            rt_ndcx = tanx / TanEyeAngleScaleX;
-                            rt_ndcy = tany / TanEyeAngleScaleY;
-
-                            x = (rt_ndcx * unwarpvr->scale_in_width / 2.0f * DeviceResX / 2) + (in_width_per_eye / 2.0f);
-                            y = (rt_ndcy * unwarpvr->scale_in_height / 2.0f * DeviceResY) + (inlink->h / 2.0f);
-
-                            srcj = (int)x;
-                            srci = (int)y;
-
-                            if (srci >= 0 && srcj >= 0 && srci < inlink->h && srcj < in_width_per_eye)
-                                unwarpvr->inv_cache[output_idx] = (srci*in_linesize) + (in_eye * in_width_per_eye + srcj)*NUM_CHANNELS + channel;
-                        }
-                    }
-                }
-            }
-        }
+    av_freep(&unwarpvr->rgb_buf);
+    unwarpvr->conv_vsub = 0;
+    if (unwarpvr->out_pix_fmt != AV_PIX_FMT_NONE && (ret = init_conversion(ctx, inlink, outlink)) < 0)
+        return ret;
+
+    // Converted slices hold whole chroma rows
+    unwarpvr->nb_slices = ctx->graph->nb_threads > 1 ? ctx->graph->nb_threads * SLICES_PER_THREAD : 1;
+    unwarpvr->nb_slices = FFMIN(FF_CEIL_RSHIFT(outlink->h, unwarpvr->conv_vsub), unwarpvr->nb_slices);
+
+    reset_static(unwarpvr);
+    av_freep(&unwarpvr->slice_changed);
+    if (unwarpvr->skip_static) {
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(inlink->format);
+
+        if ((ret = av_image_fill_linesizes(unwarpvr->cmp_w, inlink->format, inlink->w)) < 0)
+            return ret;
+        unwarpvr->cmp_planes = av_pix_fmt_count_planes(inlink->format);
+        for (i = 0; i < unwarpvr->cmp_planes; i++)
+            unwarpvr->cmp_h[i] = i == 1 || i == 2 ? FF_CEIL_RSHIFT(inlink->h, desc->log2_chroma_h) : inlink->h;
+        unwarpvr->slice_changed = av_malloc_array(unwarpvr->nb_slices, sizeof(*unwarpvr->slice_changed));
+        if (!unwarpvr->slice_changed)
+            return AVERROR(ENOMEM);
     }
 
+    av_freep(&unwarpvr->row_map);
+    av_freep(&unwarpvr->row_frac);
+    unwarpvr->band_rows = 1 << unwarpvr->conv_vsub;
+    if (unwarpvr->out_pix_fmt != AV_PIX_FMT_NONE) {
+        unwarpvr->rgb_buf_size = (size_t)unwarpvr->band_rows * unwarpvr->rgb_linesize;
+        unwarpvr->rgb_buf = av_malloc_array(unwarpvr->nb_slices, unwarpvr->rgb_buf_size);
+        if (!unwarpvr->rgb_buf)
+            return AVERROR(ENOMEM);
+    }
+    if (unwarpvr->compact || unwarpvr->symmetric) {
+        // The first plane has the widest rows, the others share its space
+        unwarpvr->row_buf_size = (size_t)unwarpvr->band_rows * outlink->w * unwarpvr->planes[0].nb_comp;
+        unwarpvr->row_map = av_malloc_array(unwarpvr->nb_slices, unwarpvr->row_buf_size * sizeof(*unwarpvr->row_map));
+        if (unwarpvr->interp != INTERP_NEAREST)
+            unwarpvr->row_frac = av_malloc_array(unwarpvr->nb_slices, unwarpvr->row_buf_size * sizeof(*unwarpvr->row_frac));
+        if (!unwarpvr->row_map || (unwarpvr->interp != INTERP_NEAREST && !unwarpvr->row_frac))
+            return AVERROR(ENOMEM);
+    }
+
+#if HAVE_PTHREADS
+    cancel_rebuild(ctx);
+#endif
+    if ((ret = init_table(ctx, inlink)) < 0)
+        return ret;
+
     return 0;
 
 fail:
@@ -889,39 +2670,481 @@ fail:
     return ret;
 }
 
+static int config_props(AVFilterLink *outlink)
+{
+    AVFilterContext *ctx = outlink->src;
+    UnwarpVRContext *unwarpvr = ctx->priv;
+    AVFilterLink *main_link = ctx->outputs[0];
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(main_link->format);
+    int i, ret;
+
+    // All outputs are cut from one remap of the stereo view, which is
+    // configured through the first output whichever link asks
+    if ((ret = config_remap(main_link)) < 0)
+        return ret;
+
+    unwarpvr->out_x[0] = unwarpvr->out_x[1] = 0;
+    unwarpvr->out_w = main_link->w;
+    if (unwarpvr->outputs == OUTPUTS_STEREO)
+        return 0;
+    if (unwarpvr->left_eye_only) {
+        av_log(ctx, AV_LOG_ERROR, "left_eye_only cannot be combined with per-eye outputs\n");
+        return AVERROR(EINVAL);
+    }
+
+    unwarpvr->out_w    = main_link->w / 2;
+    unwarpvr->out_x[0] = unwarpvr->outputs == OUTPUTS_RIGHT ? unwarpvr->out_w : 0;
+    unwarpvr->out_x[1] = unwarpvr->out_w;
+    if (!unwarpvr->out_w || unwarpvr->out_w & ((1 << desc->log2_chroma_w) - 1)) {
+        av_log(ctx, AV_LOG_ERROR, "Eye width %d is not a multiple of the chroma subsampling\n",
+               unwarpvr->out_w);
+        return AVERROR(EINVAL);
+    }
+    for (i = 0; i < ctx->nb_outputs; i++) {
+        ctx->outputs[i]->w = unwarpvr->out_w;
+        ctx->outputs[i]->h = main_link->h;
+        ctx->outputs[i]->sample_aspect_ratio = main_link->sample_aspect_ratio;
+    }
+
+    return 0;
+}
+
+typedef struct ThreadData {
+    AVFrame *in, *out[2];
+} ThreadData;
+
+/**
+ * Fill n entries worth of output samples with the plane's fill value.
+ */
+static void fill_entries(const UnwarpVRPlane *plane, uint8_t *dst, int n)
+{
+    int j;
+
+    if (plane->sample_size == 1 && !plane->whole_pixel) {
+        memset(dst, plane->fill, n);
+    } else if (plane->whole_pixel) {
+        for (j = 0; j < n; j++)
+            AV_WN32(dst + 4 * j, plane->fill);
+    } else {
+        for (j = 0; j < n; j++)
+            AV_WN16(dst + 2 * j, plane->fill);
+    }
+}
+
+/**
+ * Remap entries x0 to x1 of one output row to dst, which holds entry x0,
+ * filling the parts outside the row's spans without reading their table
+ * entries.
+ */
+static void remap_row_range(const UnwarpVRContext *unwarpvr, const UnwarpVRPlane *plane, uint8_t *dst,
+                            const uint8_t *src, int linesize, const int32_t *map, const uint16_t *frac,
+                            const RowSpan *spans, int x0, int x1)
+{
+    const int entry_size = plane->whole_pixel ? 4 : plane->sample_size;
+    int pos = x0, h;
+
+    for (h = 0; h < 2; h++) {
+        const int start = av_clip(spans[h].start, pos, x1);
+        const int end   = av_clip(spans[h].end, start, x1);
+
+        fill_entries(plane, dst + (pos - x0) * entry_size, start - pos);
+        if (end > start)
+            unwarpvr->remap_row(unwarpvr, plane, dst + (start - x0) * entry_size, src, linesize,
+                                map + start, frac ? frac + start : NULL, end - start);
+        pos = end;
+    }
+    fill_entries(plane, dst + (pos - x0) * entry_size, x1 - pos);
+}
+
+/**
+ * Remap rows i to i + nb_rows - 1 of a plane. dst[o] points to the first of
+ * these rows at the first column of output o.
+ */
+static void remap_band(const UnwarpVRContext *unwarpvr, const UnwarpVRPlane *plane, int nb_outputs,
+                       const uint8_t *src, int src_linesize, int jobnr, int i, int nb_rows,
+                       uint8_t *const *dst, const int *dst_linesize)
+{
+    const int jlimit = plane->out_w * plane->nb_comp;
+    const int out_entries = FF_CEIL_RSHIFT(unwarpvr->out_w, plane->hsub) * plane->nb_comp;
+    int32_t *row_map = unwarpvr->row_map ? unwarpvr->row_map + jobnr * unwarpvr->row_buf_size : NULL;
+    uint16_t *row_frac = unwarpvr->row_frac ? unwarpvr->row_frac + jobnr * unwarpvr->row_buf_size : NULL;
+    const int32_t *map = row_map;
+    const uint16_t *frac = row_frac;
+    int o, r;
+
+    if (unwarpvr->compact) {
+        for (r = 0; r < nb_rows; r++)
+            decode_compact_row(unwarpvr, i + r, row_map + r * jlimit,
+                               row_frac ? row_frac + r * jlimit : NULL);
+    } else if (unwarpvr->symmetric) {
+        for (r = 0; r < nb_rows; r++)
+            reflect_row(plane, i + r, row_map + r * jlimit, row_frac ? row_frac + r * jlimit : NULL,
+                        unwarpvr->inv_cache + plane->map_offset,
+                        unwarpvr->inv_frac ? unwarpvr->inv_frac + plane->map_offset : NULL);
+    } else {
+        map  = unwarpvr->inv_cache + plane->map_offset + (size_t)i * jlimit;
+        frac = unwarpvr->inv_frac ? unwarpvr->inv_frac + plane->map_offset + (size_t)i * jlimit : NULL;
+    }
+    for (o = 0; o < nb_outputs; o++) {
+        const int x_start = (unwarpvr->out_x[o] >> plane->hsub) * plane->nb_comp;
+
+        for (r = 0; r < nb_rows; r++)
+            remap_row_range(unwarpvr, plane, dst[o] + r * dst_linesize[o],
+                            src, src_linesize, map + r * jlimit, frac ? frac + r * jlimit : NULL,
+                            unwarpvr->spans[plane->spans_offset + i + r],
+                            x_start, x_start + out_entries);
+    }
+}
+
+/**
+ * Remap the output row by row. Each output gets its columns of the stereo
+ * view. Tiling the output, with the table in tile order, was measured to give
+ * no reliable gain over whole rows, so the table stays in row order.
+ */
+static int filter_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    UnwarpVRContext *unwarpvr = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *in = td->in;
+    int i, o, p;
+
+    for (p = 0; p < unwarpvr->nb_planes; p++) {
+        const UnwarpVRPlane *plane = &unwarpvr->planes[p];
+        const int slice_start = (plane->out_h *  jobnr   ) / nb_jobs;
+        const int slice_end   = (plane->out_h * (jobnr+1)) / nb_jobs;
+        uint8_t *dst[2];
+        int dst_linesize[2];
+
+        for (i = slice_start; i < slice_end; i++) {
+            for (o = 0; o < ctx->nb_outputs; o++) {
+                dst[o] = td->out[o]->data[p] + i * td->out[o]->linesize[p];
+                dst_linesize[o] = td->out[o]->linesize[p];
+            }
+            remap_band(unwarpvr, plane, ctx->nb_outputs, in->data[p], in->linesize[p],
+                       jobnr, i, 1, dst, dst_linesize);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Convert nb_rows rows of remapped packed RGB, starting at output row y, to
+ * the YUV planes of out. y and nb_rows cover whole chroma rows, except at
+ * the bottom of an odd height where the last row is duplicated. Chroma
+ * samples are the average of the pixels they cover.
+ */
+static void convert_rows(const UnwarpVRContext *unwarpvr, AVFrame *out,
+                         const uint8_t *rgb, int y, int nb_rows)
+{
+    const int (*c)[3] = unwarpvr->conv_coeffs;
+    const int step = unwarpvr->planes[0].step;
+    const int ro = unwarpvr->rgb_offset[0], go = unwarpvr->rgb_offset[1], bo = unwarpvr->rgb_offset[2];
+    const int w = unwarpvr->out_w;
+    const int hsub = unwarpvr->conv_hsub, vsub = unwarpvr->conv_vsub;
+    const int chroma_offset = (128 << (CONV_BITS + 2)) + (1 << (CONV_BITS + 1));
+    int r, x;
+
+    for (r = 0; r < nb_rows; r++) {
+        const uint8_t *s = rgb + r * unwarpvr->rgb_linesize;
+        uint8_t *dst = out->data[0] + (y + r) * out->linesize[0];
+
+        for (x = 0; x < w; x++, s += step)
+            dst[x] = av_clip_uint8((c[0][0] * s[ro] + c[0][1] * s[go] + c[0][2] * s[bo] +
+                                    unwarpvr->conv_y_offset) >> CONV_BITS);
+    }
+
+    if (!hsub && !vsub) {
+        for (r = 0; r < nb_rows; r++) {
+            const uint8_t *s = rgb + r * unwarpvr->rgb_linesize;
+            uint8_t *dst_u = out->data[1] + (y + r) * out->linesize[1];
+            uint8_t *dst_v = out->data[2] + (y + r) * out->linesize[2];
+
+            for (x = 0; x < w; x++, s += step) {
+                dst_u[x] = av_clip_uint8((c[1][0] * s[ro] + c[1][1] * s[go] + c[1][2] * s[bo] +
+                                          (chroma_offset >> 2)) >> CONV_BITS);
+                dst_v[x] = av_clip_uint8((c[2][0] * s[ro] + c[2][1] * s[go] + c[2][2] * s[bo] +
+                                          (chroma_offset >> 2)) >> CONV_BITS);
+            }
+        }
+        return;
+    }
+
+    for (r = 0; r < nb_rows; r += 1 << vsub) {
+        const uint8_t *s0 = rgb + r * unwarpvr->rgb_linesize;
+        const uint8_t *s1 = r + vsub < nb_rows ? s0 + vsub * unwarpvr->rgb_linesize : s0;
+        const int cy = (y + r) >> vsub;
+        uint8_t *dst_u = out->data[1] + cy * out->linesize[1];
+        uint8_t *dst_v = out->data[2] + cy * out->linesize[2];
+
+        for (x = 0; x < FF_CEIL_RSHIFT(w, hsub); x++) {
+            const int x0 = (x << hsub) * step;
+            const int x1 = FFMIN((x << hsub) + hsub, w - 1) * step;
+            const int sr = s0[x0 + ro] + s0[x1 + ro] + s1[x0 + ro] + s1[x1 + ro];
+            const int sg = s0[x0 + go] + s0[x1 + go] + s1[x0 + go] + s1[x1 + go];
+            const int sb = s0[x0 + bo] + s0[x1 + bo] + s1[x0 + bo] + s1[x1 + bo];
+
+            dst_u[x] = av_clip_uint8((c[1][0] * sr + c[1][1] * sg + c[1][2] * sb + chroma_offset) >> (CONV_BITS + 2));
+            dst_v[x] = av_clip_uint8((c[2][0] * sr + c[2][1] * sg + c[2][2] * sb + chroma_offset) >> (CONV_BITS + 2));
+        }
+    }
+}
+
+/**
+ * Remap packed RGB into a band buffer of the slice and convert each band to
+ * the YUV output while it is still in the cache. Slices and bands are made
+ * of whole chroma rows.
+ */
+static int filter_slice_convert(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    UnwarpVRContext *unwarpvr = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *in = td->in;
+    const UnwarpVRPlane *plane = &unwarpvr->planes[0];
+    const int chroma_h = FF_CEIL_RSHIFT(plane->out_h, unwarpvr->conv_vsub);
+    const int slice_start = ((chroma_h *  jobnr   ) / nb_jobs) << unwarpvr->conv_vsub;
+    const int slice_end   = FFMIN(((chroma_h * (jobnr+1)) / nb_jobs) << unwarpvr->conv_vsub, plane->out_h);
+    uint8_t *rgb = unwarpvr->rgb_buf + jobnr * unwarpvr->rgb_buf_size;
+    uint8_t *dst[2];
+    int dst_linesize[2];
+    int i, o;
+
+    for (o = 0; o < ctx->nb_outputs; o++) {
+        dst[o] = rgb + unwarpvr->out_x[o] * plane->step;
+        dst_linesize[o] = unwarpvr->rgb_linesize;
+    }
+    for (i = slice_start; i < slice_end; i += unwarpvr->band_rows) {
+        const int nb_rows = FFMIN(unwarpvr->band_rows, slice_end - i);
+
+        remap_band(unwarpvr, plane, ctx->nb_outputs, in->data[0], in->linesize[0],
+                   jobnr, i, nb_rows, dst, dst_linesize);
+        for (o = 0; o < ctx->nb_outputs; o++)
+            convert_rows(unwarpvr, td->out[o], dst[o], i, nb_rows);
+    }
+
+    return 0;
+}
+
+/**
+ * Sum of absolute differences of a block of w x h bytes, for the blocks at
+ * the right and bottom edges that are smaller than 16x16.
+ */
+static int sad_edge_block(const uint8_t *a, int a_linesize, const uint8_t *b, int b_linesize, int w, int h)
+{
+    int x, y, sum = 0;
+
+    for (y = 0; y < h; y++)
+        for (x = 0; x < w; x++)
+            sum += FFABS(a[y * a_linesize + x] - b[y * b_linesize + x]);
+    return sum;
+}
+
+/**
+ * Compare a slice of the rows of 16x16 blocks of every plane of two input
+ * frames, stopping at the first block that differs by more than
+ * static_thresh.
+ *
+ * @return 1 if the slices differ
+ */
+static int compare_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    const UnwarpVRContext *unwarpvr = ctx->priv;
+    const AVFrame *cur = arg, *ref = unwarpvr->prev_in;
+    int p, x, y;
+
+    for (p = 0; p < unwarpvr->cmp_planes; p++) {
+        const int w = unwarpvr->cmp_w[p], h = unwarpvr->cmp_h[p];
+        const int nb_block_rows = (h + 15) >> 4;
+        const int slice_start = ((nb_block_rows *  jobnr   ) / nb_jobs) << 4;
+        const int slice_end   = FFMIN(((nb_block_rows * (jobnr+1)) / nb_jobs) << 4, h);
+
+        // Identical frames are found faster row by row than through the SAD
+        if (!unwarpvr->static_thresh) {
+            for (y = slice_start; y < slice_end; y++)
+                if (memcmp(cur->data[p] + y * cur->linesize[p], ref->data[p] + y * ref->linesize[p], w))
+                    return 1;
+            continue;
+        }
+        for (y = slice_start; y < slice_end; y += 16) {
+            const uint8_t *a = cur->data[p] + y * cur->linesize[p];
+            const uint8_t *b = ref->data[p] + y * ref->linesize[p];
+            const int rows = FFMIN(16, h - y);
+
+            for (x = 0; x < w; x += 16) {
+                const int sad = rows == 16 && x + 16 <= w ?
+                                unwarpvr->sad(a + x, cur->linesize[p], b + x, ref->linesize[p]) :
+                                sad_edge_block(a + x, cur->linesize[p], b + x, ref->linesize[p],
+                                               FFMIN(16, w - x), rows);
+                if (sad > unwarpvr->static_thresh)
+                    return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @return 1 if in would be remapped to the same outputs as the last frame
+ */
+static int is_static(AVFilterContext *ctx, AVFrame *in)
+{
+    UnwarpVRContext *unwarpvr = ctx->priv;
+    int i;
+
+    if (!unwarpvr->prev_in)
+        return 0;
+
+    ctx->internal->execute(ctx, compare_slice, in, unwarpvr->slice_changed, unwarpvr->nb_slices);
+    for (i = 0; i < unwarpvr->nb_slices; i++)
+        if (unwarpvr->slice_changed[i])
+            return 0;
+    return 1;
+}
+
+static void set_output_props(const UnwarpVRContext *unwarpvr, AVFrame *out, const AVFrame *in)
+{
+    av_frame_copy_props(out, in);
+    if (unwarpvr->rgb_buf) {
+        av_frame_set_colorspace(out, unwarpvr->conv_colorspace);
+        av_frame_set_color_range(out, unwarpvr->conv_range);
+    }
+}
+
+/**
+ * Send new references to the outputs of the last remapped frame, with the
+ * properties of in.
+ */
+static int filter_static_frame(AVFilterContext *ctx, AVFrame *in)
+{
+    UnwarpVRContext *unwarpvr = ctx->priv;
+    int i, ret = 0;
+
+    unwarpvr->nb_static++;
+    for (i = 0; i < ctx->nb_outputs && ret >= 0; i++) {
+        AVFrame *out;
+
+        if (ctx->outputs[i]->closed)
+            continue;
+        out = av_frame_clone(unwarpvr->prev_out[i]);
+        if (!out) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        // The clone carries the properties of the frame the output was made from
+        while (out->nb_side_data)
+            av_frame_remove_side_data(out, out->side_data[0]->type);
+        av_dict_free(&out->metadata);
+        set_output_props(unwarpvr, out, in);
+        ret = ff_filter_frame(ctx->outputs[i], out);
+    }
+
+    av_frame_free(&in);
+    return ret;
+}
+
 static int filter_frame(AVFilterLink *link, AVFrame *in)
 {
     AVFilterContext *ctx = link->dst;
     UnwarpVRContext *unwarpvr = ctx->priv;
-    AVFilterLink *outlink = ctx->outputs[0];
-    AVFrame *out;
-    const uint8_t *src = in->data[0];
-    int i, j;
+    ThreadData td = { 0 };
+    int i, ret = 0;
 
-    out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
-    if (!out) {
-        av_frame_free(&in);
-        return AVERROR(ENOMEM);
+#if HAVE_PTHREADS
+    update_table(ctx);
+#endif
+
+    if (unwarpvr->skip_static) {
+        unwarpvr->nb_frames++;
+        if (is_static(ctx, in))
+            return filter_static_frame(ctx, in);
+        reset_static(unwarpvr);
     }
-    av_frame_copy_props(out, in);
-    out->width = outlink->w;
-    out->height = outlink->h;
 
-    {
-        uint8_t *dst = out->data[0];
-        int *inv_cache_p = unwarpvr->inv_cache;
-        int jlimit = outlink->w * NUM_CHANNELS;
-        int end_of_line_size = out->linesize[0] - jlimit;
-        for (i = 0; i < outlink->h; i++) {
-            for (j = 0; j < jlimit; j++, inv_cache_p++, dst++) {
-                *dst = (*inv_cache_p == -1) ? 0 : src[*inv_cache_p];
-            }
-            dst += end_of_line_size;
+    // Every output gets a frame, even a closed one, so that the slices need no checks
+    for (i = 0; i < ctx->nb_outputs; i++) {
+        AVFilterLink *outlink = ctx->outputs[i];
+        AVFrame *out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
+
+        if (!out) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        set_output_props(unwarpvr, out, in);
+        out->width  = outlink->w;
+        out->height = outlink->h;
+        td.out[i] = out;
+    }
+
+    td.in = in;
+    ctx->internal->execute(ctx, unwarpvr->rgb_buf ? filter_slice_convert : filter_slice,
+                           &td, NULL, unwarpvr->nb_slices);
+
+    if (unwarpvr->skip_static) {
+        // Keeping the last frames means that downstream filters have to
+        // copy them before writing to them
+        unwarpvr->prev_in = av_frame_clone(in);
+        for (i = 0; i < ctx->nb_outputs; i++)
+            unwarpvr->prev_out[i] = av_frame_clone(td.out[i]);
+        if (!unwarpvr->prev_in || !unwarpvr->prev_out[0] ||
+            (ctx->nb_outputs > 1 && !unwarpvr->prev_out[1]))
+            reset_static(unwarpvr);
+    }
+
+    for (i = 0; i < ctx->nb_outputs; i++) {
+        if (ctx->outputs[i]->closed || ret < 0) {
+            av_frame_free(&td.out[i]);
+            continue;
         }
+        ret = ff_filter_frame(ctx->outputs[i], td.out[i]);
+        td.out[i] = NULL;
     }
 
+end:
+    for (i = 0; i < ctx->nb_outputs; i++)
+        av_frame_free(&td.out[i]);
     av_frame_free(&in);
-    return ff_filter_frame(outlink, out);
+    return ret;
+}
+
+static int process_command(AVFilterContext *ctx, const char *cmd, const char *args,
+                           char *res, int res_len, int flags)
+{
+    UnwarpVRContext *unwarpvr = ctx->priv;
+    static const char *const table_options[] = {
+        "scale_width", "scale_height", "scale_in_width", "scale_in_height", "ppd", "eye_relief_dial", NULL
+    };
+    int old_dial = unwarpvr->eye_relief_dial;
+    int i, ret;
+
+    for (i = 0; table_options[i]; i++)
+        if (!strcmp(cmd, table_options[i]))
+            break;
+    if (!table_options[i])
+        return AVERROR(ENOSYS);
+
+    if (!strcmp(cmd, "ppd") && !unwarpvr->forward_warp) {
+        av_log(ctx, AV_LOG_ERROR, "ppd parameter only valid when forward_warp=1\n");
+        return AVERROR(EINVAL);
+    }
+    if ((ret = av_opt_set(unwarpvr, cmd, args, 0)) < 0)
+        return ret;
+    if (unwarpvr->eye_relief_dial == -1 && (ret = read_ovr_profile(ctx))) {
+        unwarpvr->eye_relief_dial = old_dial;
+        return ret;
+    }
+    // Not configured yet, config_props() will build the table
+    if (!unwarpvr->table)
+        return 0;
+
+#if HAVE_PTHREADS
+    // Started with the next frame, so that commands sent together share one rebuild
+    unwarpvr->rebuild_pending = 1;
+    return 0;
+#else
+    reset_static(unwarpvr);
+    return init_table(ctx, ctx->inputs[0]);
+#endif
 }
 
 static const AVClass *child_class_next(const AVClass *prev)
@@ -971,6 +3194,27 @@ static const AVOption unwarpvr_options[] = {
     { "device", "indicates which HMD device was used to record the video", OFFSET(device), AV_OPT_TYPE_STRING, { .str = "RiftDK2" }, .flags = FLAGS },
     { "sdkversion", "indicates what version of the HMD device's SDK was used to record the video", OFFSET(sdkversion), AV_OPT_TYPE_STRING, { .str = "default" }, .flags = FLAGS },
     { "mono_input", "indicates that the input provides only one eye view which should be used for both eyes", OFFSET(mono_input), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, FLAGS },
+    { "interp", "select interpolation mode", OFFSET(interp), AV_OPT_TYPE_INT, { .i64 = INTERP_NEAREST }, 0, NB_INTERP_MODE-1, FLAGS, "interp" },
+        { "nearest",  "use the nearest source pixel",             0, AV_OPT_TYPE_CONST, { .i64 = INTERP_NEAREST },  INT_MIN, INT_MAX, FLAGS, "interp" },
+        { "bilinear", "interpolate between 2x2 source pixels",    0, AV_OPT_TYPE_CONST, { .i64 = INTERP_BILINEAR }, INT_MIN, INT_MAX, FLAGS, "interp" },
+        { "bicubic",  "interpolate between 4x4 source pixels",    0, AV_OPT_TYPE_CONST, { .i64 = INTERP_BICUBIC },  INT_MIN, INT_MAX, FLAGS, "interp" },
+    { "compact", "store the remap table as 16-bit displacements decoded on the fly; uses much less memory, but remaps several times slower", OFFSET(compact), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, FLAGS },
+    { "symmetric", "store only the part of the remap table that is not a mirror image of another part", OFFSET(symmetric), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, FLAGS },
+    { "chromatic_aberration", "correct the chromatic aberration of the lens", OFFSET(correct_ca), AV_OPT_TYPE_INT, { .i64 = 1 }, 0, 1, FLAGS },
+    { "out_pix_fmt", "convert packed RGB input to this YUV format in the same pass", OFFSET(out_pix_fmt), AV_OPT_TYPE_PIXEL_FMT, { .i64 = AV_PIX_FMT_NONE }, AV_PIX_FMT_NONE, INT_MAX, FLAGS },
+    { "outputs", "select the views to output", OFFSET(outputs), AV_OPT_TYPE_INT, { .i64 = OUTPUTS_STEREO }, 0, NB_OUTPUTS_MODE-1, FLAGS, "outputs" },
+        { "stereo",    "one output with both eyes side by side", 0, AV_OPT_TYPE_CONST, { .i64 = OUTPUTS_STEREO },    INT_MIN, INT_MAX, FLAGS, "outputs" },
+        { "left",      "one output with the left eye",           0, AV_OPT_TYPE_CONST, { .i64 = OUTPUTS_LEFT },      INT_MIN, INT_MAX, FLAGS, "outputs" },
+        { "right",     "one output with the right eye",          0, AV_OPT_TYPE_CONST, { .i64 = OUTPUTS_RIGHT },     INT_MIN, INT_MAX, FLAGS, "outputs" },
+        { "both_eyes", "a left and a right output",               0, AV_OPT_TYPE_CONST, { .i64 = OUTPUTS_BOTH_EYES }, INT_MIN, INT_MAX, FLAGS, "outputs" },
+    { "skip_static", "resend the last output for input frames that did not change", OFFSET(skip_static), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, FLAGS },
+    { "static_thresh", "set the largest SAD of a 16x16 block of bytes of a static frame", OFFSET(static_thresh), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, FLAGS },
+    { "projection", "select the projection of the unwarped output", OFFSET(projection), AV_OPT_TYPE_INT, { .i64 = PROJECTION_RECTILINEAR }, 0, NB_PROJECTION-1, FLAGS, "projection" },
+        { "rectilinear", "a flat view, as the lens shows it",         0, AV_OPT_TYPE_CONST, { .i64 = PROJECTION_RECTILINEAR }, INT_MIN, INT_MAX, FLAGS, "projection" },
+        { "equirect",    "equirectangular, linear in angle",          0, AV_OPT_TYPE_CONST, { .i64 = PROJECTION_EQUIRECT },    INT_MIN, INT_MAX, FLAGS, "projection" },
+        { "cubemap",     "six 90 degree faces in a 3x2 grid per eye", 0, AV_OPT_TYPE_CONST, { .i64 = PROJECTION_CUBEMAP },     INT_MIN, INT_MAX, FLAGS, "projection" },
+    { "map_cache", "file to load the remap table from, or to save it to if missing", OFFSET(map_cache), AV_OPT_TYPE_STRING, { .str = NULL }, .flags = FLAGS },
+    { "rebuild_wait", "wait for the table rebuilt after a command instead of remapping with the old one meanwhile", OFFSET(rebuild_wait), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, FLAGS },
     { NULL }
 };
 
@@ -992,15 +3236,6 @@ static const AVFilterPad avfilter_vf_unwarpvr_inputs[] = {
     { NULL }
 };
 
-static const AVFilterPad avfilter_vf_unwarpvr_outputs[] = {
-    {
-        .name         = "default",
-        .type         = AVMEDIA_TYPE_VIDEO,
-        .config_props = config_props,
-    },
-    { NULL }
-};
-
 AVFilter ff_vf_unwarpvr = {
     .name          = "unwarpvr",
     .description   = NULL_IF_CONFIG_SMALL("Reverses the lens distortion correction and chromatic abberation correction performed by virtual reality head-mounted displays."),
@@ -1010,5 +3245,121 @@ AVFilter ff_vf_unwarpvr = {
     .priv_size     = sizeof(UnwarpVRContext),
     .priv_class    = &unwarpvr_class,
     .inputs        = avfilter_vf_unwarpvr_inputs,
-    .outputs       = avfilter_vf_unwarpvr_outputs,
+    .outputs       = NULL,
+    .process_command = process_command,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS | AVFILTER_FLAG_DYNAMIC_OUTPUTS,
 };
+
+#ifdef TEST
+
+#include "libavutil/lfg.h"
+
+#undef printf
+
+/**
+ * Compare the optimized nearest remap kernels against the C ones on random
+ * tables with invalid entries, every source alignment and odd lengths.
+ */
+static int check_remap_nearest(void)
+{
+    static const int widths[] = { 1, 7, 8, 9, 31, 64, 333 };
+    enum { SRC_W = 203, SRC_H = 37 };
+    UnwarpVRDSPContext ref, opt;
+    DECLARE_ALIGNED(32, uint8_t, src)[SRC_H * SRC_W + 4];
+    uint8_t dst_ref[4 * 333], dst_opt[4 * 333];
+    int32_t map[333];
+    AVLFG lfg;
+    int size, mis, linesize, w, j, ret = 0;
+
+    ref.remap_nearest   = opt.remap_nearest   = ff_unwarpvr_remap_nearest_c;
+    ref.remap_nearest16 = opt.remap_nearest16 = ff_unwarpvr_remap_nearest16_c;
+    ref.remap_nearest32 = opt.remap_nearest32 = ff_unwarpvr_remap_nearest32_c;
+    if (ARCH_X86)
+        ff_unwarpvr_init_x86(&opt);
+
+    av_lfg_init(&lfg, 0xdeadbeef);
+    for (j = 0; j < sizeof(src); j++)
+        src[j] = av_lfg_get(&lfg);
+
+    for (size = 1; size <= 4; size <<= 1) {
+        for (mis = 0; mis < 4; mis++) {
+            for (linesize = SRC_W - 1; linesize <= SRC_W; linesize++) {
+                for (w = 0; w < FF_ARRAY_ELEMS(widths); w++) {
+                    const int n = widths[w];
+                    void (*remap_ref)(uint8_t *, const uint8_t *, int, const int32_t *, int, int) =
+                        size == 1 ? ref.remap_nearest : size == 2 ? ref.remap_nearest16 : ref.remap_nearest32;
+                    void (*remap_opt)(uint8_t *, const uint8_t *, int, const int32_t *, int, int) =
+                        size == 1 ? opt.remap_nearest : size == 2 ? opt.remap_nearest16 : opt.remap_nearest32;
+                    const int fill = av_lfg_get(&lfg);
+                    const int step = size == 2 ? 2 : 1;
+
+                    for (j = 0; j < n; j++) {
+                        int x = av_lfg_get(&lfg) % ((linesize - size) / step + 1) * step;
+                        int y = av_lfg_get(&lfg) % SRC_H;
+                        map[j] = av_lfg_get(&lfg) % 8 ? x | y << UNWARPVR_MAP_X_BITS : -1;
+                    }
+                    memset(dst_ref, 0, sizeof(dst_ref));
+                    memset(dst_opt, 0, sizeof(dst_opt));
+                    remap_ref(dst_ref, src + mis, linesize, map, n, fill);
+                    remap_opt(dst_opt, src + mis, linesize, map, n, fill);
+                    if (memcmp(dst_ref, dst_opt, sizeof(dst_ref))) {
+                        printf("remap_nearest%d: mismatch for n=%d linesize=%d misalignment %d\n",
+                               8 * size, n, linesize, mis);
+                        ret = 1;
+                    }
+                }
+            }
+        }
+    }
+    return ret;
+}
+
+int main(void)
+{
+    static const struct {
+        const char *device, *sdkversion;
+        int eye_relief_dial;
+    } configs[] = {
+        { "RiftDK1", "0.2.5c",  0 },
+        { "RiftDK1", "0.4.2",   0 },
+        { "RiftDK2", "0.4.2",   0 },
+        { "RiftDK2", "0.4.2",  10 },
+    };
+    // Well beyond the corners of a full DK2 frame, as reached when zooming out
+    static const float rsq_max = 4.0f;
+    static const int nb_samples = 100003;
+    DistortionInvLUT lut;
+    DeviceParams dev;
+    int i, channel, k, ret = 0;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(configs); i++) {
+        if (get_device_params(NULL, configs[i].device, configs[i].sdkversion,
+                              configs[i].eye_relief_dial, &dev) < 0)
+            return 1;
+        for (channel = 0; channel < NUM_CHANNELS; channel++) {
+            float ca0 = channel == 1 ? 0.0f : dev.ChromaticAberration[channel];
+            float ca1 = channel == 1 ? 0.0f : dev.ChromaticAberration[channel + 1];
+            float max_err = 0.0f;
+
+            init_distortion_inv_lut(&lut, dev.Eqn, dev.K, dev.MaxR, ca0, ca1, rsq_max);
+            for (k = 1; k <= nb_samples; k++) {
+                float rsq = k * rsq_max / nb_samples;
+                float ref = sqrt(DistortionFnScaleRadiusSquaredInv(dev.Eqn, dev.K, dev.MaxR, ca0, ca1, rsq) / rsq);
+                float val = sqrt(distortion_inv_ratio(&lut, rsq));
+                max_err = FFMAX(max_err, fabsf(val - ref) / ref);
+            }
+            // The bisection used to be run per pixel with a relative tolerance of 1e-4 on rsq
+            if (max_err > 0.00005f) {
+                printf("%s %s eye_relief_dial=%d channel %d: relative error %g\n",
+                       configs[i].device, configs[i].sdkversion,
+                       configs[i].eye_relief_dial, channel, max_err);
+                ret = 1;
+            }
+        }
+    }
+    if (check_remap_nearest())
+        ret = 1;
+    return ret;
+}
+
+#endif
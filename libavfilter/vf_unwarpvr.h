@@ -0,0 +1,58 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_UNWARPVR_H
+#define AVFILTER_UNWARPVR_H
+
+#include <stdint.h>
+
+/**
+ * Remap table entries are x | y << UNWARPVR_MAP_X_BITS, where y is the input
+ * row and x the byte offset within it, or -1 for samples outside the input.
+ */
+#define UNWARPVR_MAP_X_BITS 16
+
+typedef struct UnwarpVRDSPContext {
+    /**
+     * Gather n bytes, dst[i] = the input byte at map[i], or fill where map[i]
+     * is negative.
+     * Optimized versions load the aligned 32-bit word holding each sample,
+     * which may reach up to 3 bytes around it within the same word.
+     */
+    void (*remap_nearest)(uint8_t *dst, const uint8_t *src, int linesize, const int32_t *map, int n, int fill);
+
+    /**
+     * Gather n 16-bit samples, dst[i] = the input sample at map[i], or fill
+     * where map[i] is negative. The byte offsets x in map must be even.
+     */
+    void (*remap_nearest16)(uint8_t *dst, const uint8_t *src, int linesize, const int32_t *map, int n, int fill);
+
+    /**
+     * Gather n 32-bit pixels, dst[i] = the input pixel at map[i], or fill
+     * where map[i] is negative. The pixels need not be aligned.
+     */
+    void (*remap_nearest32)(uint8_t *dst, const uint8_t *src, int linesize, const int32_t *map, int n, int fill);
+} UnwarpVRDSPContext;
+
+void ff_unwarpvr_init_x86(UnwarpVRDSPContext *dsp);
+
+void ff_unwarpvr_remap_nearest_c(uint8_t *dst, const uint8_t *src, int linesize, const int32_t *map, int n, int fill);
+void ff_unwarpvr_remap_nearest16_c(uint8_t *dst, const uint8_t *src, int linesize, const int32_t *map, int n, int fill);
+void ff_unwarpvr_remap_nearest32_c(uint8_t *dst, const uint8_t *src, int linesize, const int32_t *map, int n, int fill);
+
+#endif /* AVFILTER_UNWARPVR_H */
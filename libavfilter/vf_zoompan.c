@@ -135,7 +135,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     var_values[VAR_OUT_W] = var_values[VAR_OW] = s->w;
     var_values[VAR_OUT_H] = var_values[VAR_OH] = s->h;
     var_values[VAR_IN]    = inlink->frame_count + 1;
-    var_values[VAR_ON]    = outlink->frame_count + 1;
+    var_values[VAR_ON]    = outlink->frame_count_in + 1;
     var_values[VAR_PX]    = s->x;
     var_values[VAR_PY]    = s->y;
     var_values[VAR_X]     = 0;
@@ -165,7 +165,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 
         var_values[VAR_TIME] = pts * av_q2d(outlink->time_base);
         var_values[VAR_FRAME] = i;
-        var_values[VAR_ON] = outlink->frame_count + 1;
+        var_values[VAR_ON] = outlink->frame_count_in + 1;
         if ((ret = av_expr_parse_and_eval(&zoom, s->zoom_expr_str,
                                           var_names, var_values,
                                           NULL, NULL, NULL, NULL, NULL, 0, ctx)) < 0)
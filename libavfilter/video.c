@@ -29,6 +29,7 @@
 #include "libavutil/mem.h"
 
 #include "avfilter.h"
+#include "framepool.h"
 #include "internal.h"
 #include "video.h"
 
@@ -37,26 +38,15 @@ AVFrame *ff_null_get_video_buffer(AVFilterLink *link, int w, int h)
     return ff_get_video_buffer(link->dst->outputs[0], w, h);
 }
 
-/* TODO: set the buffer's priv member to a context structure for the whole
- * filter chain.  This will allow for a buffer pool instead of the constant
- * alloc & free cycle currently implemented. */
 AVFrame *ff_default_get_video_buffer(AVFilterLink *link, int w, int h)
 {
-    AVFrame *frame = av_frame_alloc();
-    int ret;
+    if (!link->frame_pool) {
+        link->frame_pool = ff_video_frame_pool_alloc(32);
+        if (!link->frame_pool)
+            return NULL;
+    }
 
-    if (!frame)
-        return NULL;
-
-    frame->width  = w;
-    frame->height = h;
-    frame->format = link->format;
-
-    ret = av_frame_get_buffer(frame, 32);
-    if (ret < 0)
-        av_frame_free(&frame);
-
-    return frame;
+    return ff_video_frame_pool_get(link->frame_pool, w, h, link->format);
 }
 
 #if FF_API_AVFILTERBUFFER
@@ -112,7 +102,8 @@ AVFrame *ff_get_video_buffer(AVFilterLink *link, int w, int h)
 
     FF_TPRINTF_START(NULL, get_video_buffer); ff_tlog_link(NULL, link, 0);
 
-    if (link->dstpad->get_video_buffer)
+    /* the destination of a pipelined link runs on another thread */
+    if (link->dstpad->get_video_buffer && !link->pipe)
         ret = link->dstpad->get_video_buffer(link, w, h);
 
     if (!ret)
@@ -0,0 +1,176 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/attributes.h"
+#include "libavutil/cpu.h"
+#include "libavutil/mem.h"
+#include "libavutil/x86/asm.h"
+#include "libavutil/x86/cpu.h"
+#include "libavfilter/vf_unwarpvr.h"
+
+#if HAVE_AVX2_INLINE
+DECLARE_ALIGNED(32, static const int32_t, lo16)[8] = {
+    0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF
+};
+DECLARE_ALIGNED(32, static const int32_t, not3)[8] = { ~3, ~3, ~3, ~3, ~3, ~3, ~3, ~3 };
+DECLARE_ALIGNED(32, static const int32_t, shift8)[8]  = { 24, 24, 24, 24, 24, 24, 24, 24 };
+DECLARE_ALIGNED(32, static const int32_t, shift16)[8] = { 16, 16, 16, 16, 16, 16, 16, 16 };
+// Low byte or word of each dword to the start of its lane
+DECLARE_ALIGNED(32, static const uint8_t, pick8)[32] = {
+    0, 4, 8, 12, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0, 4, 8, 12, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+};
+DECLARE_ALIGNED(32, static const uint8_t, pick16)[32] = {
+    0, 1, 4, 5, 8, 9, 12, 13, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0, 1, 4, 5, 8, 9, 12, 13, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+};
+DECLARE_ALIGNED(32, static const int32_t, join8)[8] = { 0, 4, 0, 0, 0, 0, 0, 0 };
+
+/*
+ * Input offsets of 8 entries of map + i into ymm0, and the gather mask into
+ * ymm1: all ones for valid entries, zero for the -1 ones. ymm6 gets the
+ * inverse of the mask, ymm5 must be all ones.
+ */
+#define LOAD_OFFSETS(map, lin)                                      \
+    "vmovdqu  ("map", %0, 4), %%ymm0            \n\t"               \
+    "vpsrad   $31, %%ymm0, %%ymm6                \n\t"               \
+    "vpxor    %%ymm5, %%ymm6, %%ymm1             \n\t"               \
+    "vpsrld   $16, %%ymm0, %%ymm2                \n\t"               \
+    "vpmulld  "lin", %%ymm2, %%ymm2              \n\t"               \
+    "vpand    %[lo16], %%ymm0, %%ymm0            \n\t"               \
+    "vpaddd   %%ymm2, %%ymm0, %%ymm0             \n\t"
+
+static void remap_nearest32_avx2(uint8_t *dst, const uint8_t *src, int linesize,
+                                 const int32_t *map, int n, int fill)
+{
+    DECLARE_ALIGNED(32, int32_t, lin)[8];
+    DECLARE_ALIGNED(32, int32_t, fills)[8];
+    x86_reg i = 0, len = n & ~7;
+    int k;
+
+    for (k = 0; k < 8; k++) {
+        lin[k]   = linesize;
+        fills[k] = fill;
+    }
+
+    if (len) {
+        __asm__ volatile (
+            "vpcmpeqd %%ymm5, %%ymm5, %%ymm5         \n\t"
+            ".p2align 4                              \n\t"
+            "1:                                      \n\t"
+            LOAD_OFFSETS("%2", "%[lin]")
+            "vmovdqu  %[fill], %%ymm3                \n\t"
+            "vpgatherdd %%ymm1, (%3, %%ymm0, 1), %%ymm3 \n\t"
+            "vmovdqu  %%ymm3, (%1, %0, 4)            \n\t"
+            "add      $8, %0                         \n\t"
+            "cmp      %4, %0                         \n\t"
+            " jl 1b                                  \n\t"
+            "vzeroupper                              \n\t"
+            : "+&r"(i)
+            : "r"(dst), "r"(map), "r"(src), "r"(len),
+              [lin]"m"(lin), [fill]"m"(fills), [lo16]"m"(lo16)
+            : XMM_CLOBBERS("xmm0", "xmm1", "xmm2", "xmm3", "xmm5", "xmm6",)
+              "memory", "cc"
+        );
+    }
+    if (len < n)
+        ff_unwarpvr_remap_nearest32_c(dst + 4 * len, src, linesize, map + len, n - len, fill);
+}
+
+/*
+ * The byte and 16-bit kernels gather the aligned dword holding each sample,
+ * which never crosses into another page, and shift the sample down. Invalid
+ * entries keep the fill value with a shift of 0.
+ */
+#define REMAP_SMALL_AVX2(bits, scale, store)                                        \
+static void remap_nearest ## bits ## _avx2(uint8_t *dst, const uint8_t *src, int linesize, \
+                                           const int32_t *map, int n, int fill)       \
+{                                                                                   \
+    DECLARE_ALIGNED(32, int32_t, lin)[8];                                           \
+    DECLARE_ALIGNED(32, int32_t, fills)[8];                                         \
+    DECLARE_ALIGNED(32, int32_t, mis)[8];                                           \
+    const int misalign = (uintptr_t)src & 3;                                        \
+    x86_reg i = 0, len = n & ~7;                                                    \
+    int k;                                                                          \
+                                                                                    \
+    for (k = 0; k < 8; k++) {                                                       \
+        lin[k]   = linesize;                                                        \
+        fills[k] = fill;                                                            \
+        mis[k]   = misalign;                                                        \
+    }                                                                               \
+                                                                                    \
+    /* a 16-bit sample must not straddle two dwords */                             \
+    if (len && (bits == 8 || !((misalign | linesize) & 1))) {                       \
+        __asm__ volatile (                                                          \
+            "vpcmpeqd %%ymm5, %%ymm5, %%ymm5         \n\t"                          \
+            "vmovdqu  %[join], %%ymm7                \n\t"                          \
+            ".p2align 4                              \n\t"                          \
+            "1:                                      \n\t"                          \
+            LOAD_OFFSETS("%2", "%[lin]")                                            \
+            "vpaddd   %[mis], %%ymm0, %%ymm0         \n\t"                          \
+            "vpslld   $3, %%ymm0, %%ymm3             \n\t"                          \
+            "vpand    %[shift], %%ymm3, %%ymm3       \n\t"                          \
+            "vpandn   %%ymm3, %%ymm6, %%ymm3         \n\t"                          \
+            "vpand    %[not3], %%ymm0, %%ymm0        \n\t"                          \
+            "vpsubd   %[mis], %%ymm0, %%ymm0         \n\t"                          \
+            "vmovdqu  %[fill], %%ymm4                \n\t"                          \
+            "vpgatherdd %%ymm1, (%3, %%ymm0, 1), %%ymm4 \n\t"                       \
+            "vpsrlvd  %%ymm3, %%ymm4, %%ymm4         \n\t"                          \
+            "vpshufb  %[pick], %%ymm4, %%ymm4        \n\t"                          \
+            store                                                                   \
+            "add      $8, %0                         \n\t"                          \
+            "cmp      %4, %0                         \n\t"                          \
+            " jl 1b                                  \n\t"                          \
+            "vzeroupper                              \n\t"                          \
+            : "+&r"(i)                                                              \
+            : "r"(dst), "r"(map), "r"(src), "r"(len),                               \
+              [lin]"m"(lin), [fill]"m"(fills), [mis]"m"(mis), [lo16]"m"(lo16),      \
+              [not3]"m"(not3), [shift]"m"(shift ## bits), [pick]"m"(pick ## bits),  \
+              [join]"m"(join8)                                                      \
+            : XMM_CLOBBERS("xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5",          \
+                           "xmm6", "xmm7",)                                         \
+              "memory", "cc"                                                        \
+        );                                                                          \
+    } else {                                                                        \
+        len = 0;                                                                    \
+    }                                                                               \
+    if (len < n)                                                                    \
+        ff_unwarpvr_remap_nearest ## scale ## _c(dst + bits / 8 * len, src, linesize, \
+                                                 map + len, n - len, fill);         \
+}
+
+REMAP_SMALL_AVX2(8,  ,
+                 "vpermd   %%ymm4, %%ymm7, %%ymm4         \n\t"
+                 "vmovq    %%xmm4, (%1, %0, 1)            \n\t")
+REMAP_SMALL_AVX2(16, 16,
+                 "vpermq   $0x08, %%ymm4, %%ymm4          \n\t"
+                 "vmovdqu  %%xmm4, (%1, %0, 2)            \n\t")
+#endif /* HAVE_AVX2_INLINE */
+
+av_cold void ff_unwarpvr_init_x86(UnwarpVRDSPContext *dsp)
+{
+#if HAVE_AVX2_INLINE
+    int cpu_flags = av_get_cpu_flags();
+
+    if (INLINE_AVX2(cpu_flags)) {
+        dsp->remap_nearest   = remap_nearest8_avx2;
+        dsp->remap_nearest16 = remap_nearest16_avx2;
+        dsp->remap_nearest32 = remap_nearest32_avx2;
+    }
+#endif
+}
@@ -0,0 +1,380 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include "common.h"
+#include "cpu.h"
+#include "error.h"
+#include "executor.h"
+#include "internal.h"
+#include "mem.h"
+
+#if HAVE_THREADS
+#if HAVE_PTHREADS
+#include <pthread.h>
+#elif HAVE_W32THREADS
+#include "compat/w32pthreads.h"
+#elif HAVE_OS2THREADS
+#include "compat/os2threads.h"
+#else
+#error "Unknown threads implementation"
+#endif
+#endif
+
+typedef struct ExecutorBatch {
+    AVExecutorFunc *func;
+    void *ctx;
+    void *arg;
+    int *rets;
+    int nb_rets;
+    int nb_jobs;
+    int max_threads;
+    int priority;
+
+    int next_job;           ///< next job to start
+    int nb_finished;        ///< number of jobs done
+    int nb_threads;         ///< number of threads that joined, the caller included
+    int queued;             ///< the batch is in AVExecutor.batches
+    struct ExecutorBatch *next;
+} ExecutorBatch;
+
+struct AVExecutor {
+    int nb_threads;
+#if HAVE_THREADS
+    pthread_t *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;
+    pthread_cond_t finished_cond;
+
+    /**
+     * Batches that idle threads may join, by decreasing priority and in
+     * submission order for equal priorities.
+     */
+    ExecutorBatch *batches;
+    int done;
+#endif
+};
+
+static void run_serial(AVExecutorFunc *func, void *ctx, void *arg,
+                       int *ret, int nb_jobs)
+{
+    int i;
+
+    for (i = 0; i < nb_jobs; i++) {
+        int r = func(ctx, arg, i, 0);
+        if (ret)
+            ret[i] = r;
+    }
+}
+
+int av_executor_get_nb_threads(const AVExecutor *e)
+{
+    return e->nb_threads;
+}
+
+#if HAVE_THREADS
+
+static void batch_unqueue(AVExecutor *e, ExecutorBatch *b)
+{
+    ExecutorBatch **p = &e->batches;
+
+    if (!b->queued)
+        return;
+    while (*p != b)
+        p = &(*p)->next;
+    *p = b->next;
+    b->queued = 0;
+}
+
+/* Called with the lock held, returns with it held. */
+static void batch_run(AVExecutor *e, ExecutorBatch *b, int threadnr)
+{
+    while (b->next_job < b->nb_jobs) {
+        int job = b->next_job++;
+        int ret;
+
+        if (b->next_job == b->nb_jobs)
+            batch_unqueue(e, b);
+        pthread_mutex_unlock(&e->lock);
+
+        ret = b->func(b->ctx, b->arg, job, threadnr);
+
+        pthread_mutex_lock(&e->lock);
+        b->rets[job % b->nb_rets] = ret;
+        if (++b->nb_finished == b->nb_jobs)
+            pthread_cond_broadcast(&e->finished_cond);
+    }
+}
+
+static void* attribute_align_arg worker(void *v)
+{
+    AVExecutor *e = v;
+
+    pthread_mutex_lock(&e->lock);
+    for (;;) {
+        ExecutorBatch *b;
+        int threadnr;
+
+        while (!e->done && !e->batches)
+            pthread_cond_wait(&e->work_cond, &e->lock);
+        if (e->done)
+            break;
+
+        b = e->batches;
+        threadnr = b->nb_threads++;
+        if (b->nb_threads == b->max_threads)
+            batch_unqueue(e, b);
+        batch_run(e, b, threadnr);
+    }
+    pthread_mutex_unlock(&e->lock);
+
+    return NULL;
+}
+
+int av_executor_execute(AVExecutor *e, AVExecutorFunc *func, void *ctx,
+                        void *arg, int *ret, int nb_jobs, int max_threads,
+                        int priority)
+{
+    ExecutorBatch b = { 0 }, **p;
+    int dummy_ret, i;
+
+    if (nb_jobs <= 0)
+        return 0;
+    max_threads = FFMIN(max_threads, nb_jobs);
+    if (max_threads <= 1) {
+        run_serial(func, ctx, arg, ret, nb_jobs);
+        return 0;
+    }
+
+    b.func        = func;
+    b.ctx         = ctx;
+    b.arg         = arg;
+    b.nb_jobs     = nb_jobs;
+    b.max_threads = max_threads;
+    b.priority    = priority;
+    b.nb_threads  = 1;
+    if (ret) {
+        b.rets    = ret;
+        b.nb_rets = nb_jobs;
+    } else {
+        b.rets    = &dummy_ret;
+        b.nb_rets = 1;
+    }
+
+    pthread_mutex_lock(&e->lock);
+
+    for (p = &e->batches; *p && (*p)->priority >= priority; p = &(*p)->next)
+        ;
+    b.next   = *p;
+    b.queued = 1;
+    *p = &b;
+    for (i = 1; i < max_threads; i++)
+        pthread_cond_signal(&e->work_cond);
+
+    batch_run(e, &b, 0);
+    while (b.nb_finished < b.nb_jobs)
+        pthread_cond_wait(&e->finished_cond, &e->lock);
+
+    pthread_mutex_unlock(&e->lock);
+
+    return 0;
+}
+
+static void executor_stop(AVExecutor *e, int nb_workers)
+{
+    int i;
+
+    pthread_mutex_lock(&e->lock);
+    e->done = 1;
+    pthread_cond_broadcast(&e->work_cond);
+    pthread_mutex_unlock(&e->lock);
+
+    for (i = 0; i < nb_workers; i++)
+        pthread_join(e->workers[i], NULL);
+
+    pthread_cond_destroy(&e->finished_cond);
+    pthread_cond_destroy(&e->work_cond);
+    pthread_mutex_destroy(&e->lock);
+    av_freep(&e->workers);
+}
+
+int av_executor_alloc(AVExecutor **pe, int nb_threads)
+{
+    AVExecutor *e;
+    int i, ret;
+
+    *pe = NULL;
+
+    if (!nb_threads)
+        nb_threads = av_cpu_count();
+    if (nb_threads < 0)
+        return AVERROR(EINVAL);
+
+    if (!(e = av_mallocz(sizeof(*e))))
+        return AVERROR(ENOMEM);
+    if (!(e->workers = av_mallocz_array(nb_threads, sizeof(*e->workers)))) {
+        av_free(e);
+        return AVERROR(ENOMEM);
+    }
+    e->nb_threads = nb_threads;
+
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->work_cond, NULL);
+    pthread_cond_init(&e->finished_cond, NULL);
+
+    for (i = 0; i < nb_threads; i++) {
+        if ((ret = pthread_create(&e->workers[i], NULL, worker, e))) {
+            executor_stop(e, i);
+            av_free(e);
+            return AVERROR(ret);
+        }
+    }
+
+    *pe = e;
+    return 0;
+}
+
+void av_executor_free(AVExecutor **pe)
+{
+    AVExecutor *e = *pe;
+
+    if (!e)
+        return;
+    executor_stop(e, e->nb_threads);
+    av_freep(pe);
+}
+
+#else
+
+int av_executor_execute(AVExecutor *e, AVExecutorFunc *func, void *ctx,
+                        void *arg, int *ret, int nb_jobs, int max_threads,
+                        int priority)
+{
+    run_serial(func, ctx, arg, ret, nb_jobs);
+    return 0;
+}
+
+int av_executor_alloc(AVExecutor **pe, int nb_threads)
+{
+    *pe = NULL;
+    return AVERROR(ENOSYS);
+}
+
+void av_executor_free(AVExecutor **pe)
+{
+    av_freep(pe);
+}
+
+#endif /* HAVE_THREADS */
+
+#ifdef TEST
+
+#include "atomic.h"
+
+#define MAX_JOBS 100
+
+typedef struct TestContext {
+    int ran[MAX_JOBS];
+    volatile int busy[MAX_JOBS];
+    int max_threads;
+    int errors;
+} TestContext;
+
+static int test_job(void *ctx, void *arg, int jobnr, int threadnr)
+{
+    TestContext *t = ctx;
+    int i;
+
+    if (threadnr < 0 || threadnr >= t->max_threads ||
+        avpriv_atomic_int_add_and_fetch(&t->busy[threadnr], 1) != 1) {
+        t->errors++;
+        return -1;
+    }
+    for (i = 0; i < 10000 * (jobnr % 4); i++)
+        avpriv_atomic_int_get(&t->busy[threadnr]);
+    t->ran[jobnr]++;
+    avpriv_atomic_int_add_and_fetch(&t->busy[threadnr], -1);
+
+    return jobnr;
+}
+
+static int test_execute(AVExecutor *e, int nb_jobs, int max_threads, int priority)
+{
+    TestContext t = { { 0 } };
+    int ret[MAX_JOBS];
+    int i, errors;
+
+    t.max_threads = max_threads;
+    av_executor_execute(e, test_job, &t, NULL, ret, nb_jobs, max_threads, priority);
+
+    errors = t.errors;
+    for (i = 0; i < nb_jobs; i++)
+        errors += t.ran[i] != 1 || ret[i] != i;
+    return errors;
+}
+
+#if HAVE_THREADS
+static void *test_thread(void *v)
+{
+    AVExecutor *e = v;
+    int i, errors = 0;
+
+    for (i = 0; i < 50; i++)
+        errors += test_execute(e, 1 + i % MAX_JOBS, 1 + i % 5, i % 3);
+    return errors ? e : NULL;
+}
+#endif
+
+int main(void)
+{
+    static const int tests[][2] = {
+        { 1, 1 }, { 1, 4 }, { 7, 2 }, { 16, 4 }, { 100, 3 }, { 100, 16 },
+    };
+    AVExecutor *e;
+    int i;
+
+    if (av_executor_alloc(&e, 3) < 0)
+        return 1;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(tests); i++)
+        printf("nb_jobs %3d max_threads %2d: %s\n", tests[i][0], tests[i][1],
+               test_execute(e, tests[i][0], tests[i][1], 0) ? "failed" : "ok");
+
+#if HAVE_THREADS
+    {
+        pthread_t threads[4];
+        void *thread_ret;
+        int errors = 0;
+
+        for (i = 0; i < FF_ARRAY_ELEMS(threads); i++)
+            if (pthread_create(&threads[i], NULL, test_thread, e))
+                return 1;
+        for (i = 0; i < FF_ARRAY_ELEMS(threads); i++) {
+            pthread_join(threads[i], &thread_ret);
+            errors += !!thread_ret;
+        }
+        printf("concurrent executes: %s\n", errors ? "failed" : "ok");
+    }
+#endif
+
+    av_executor_free(&e);
+    return 0;
+}
+
+#endif
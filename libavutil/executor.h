@@ -0,0 +1,86 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVUTIL_EXECUTOR_H
+#define AVUTIL_EXECUTOR_H
+
+/**
+ * @file
+ * Pool of threads shared by several slice-threaded contexts, so that the
+ * total number of threads stays bounded however many of them are open.
+ *
+ * A context opts in by having its executor field set before it is
+ * initialized, see AVFilterGraph.executor and AVCodecContext.executor.
+ */
+
+typedef struct AVExecutor AVExecutor;
+
+/**
+ * Function run for each job of an execute.
+ *
+ * @param ctx      the ctx passed to av_executor_execute()
+ * @param arg      the arg passed to av_executor_execute()
+ * @param jobnr    index of the job, from 0 to nb_jobs - 1
+ * @param threadnr index of the thread running the job, from 0 to
+ *                 max_threads - 1; no two jobs of the same execute run
+ *                 at the same time with the same threadnr
+ */
+typedef int (AVExecutorFunc)(void *ctx, void *arg, int jobnr, int threadnr);
+
+/**
+ * Allocate an executor and start its threads.
+ *
+ * @param e          pointer to the executor
+ * @param nb_threads number of threads of the pool, 0 for one per CPU core;
+ *                   the threads calling av_executor_execute() run jobs too
+ * @return  >=0 for success; <0 for error, in particular AVERROR(ENOSYS) if
+ *          lavu was built without thread support
+ */
+int av_executor_alloc(AVExecutor **e, int nb_threads);
+
+/**
+ * Stop the threads and free an executor.
+ *
+ * The executor must no longer be used by any context.
+ */
+void av_executor_free(AVExecutor **e);
+
+/**
+ * @return the number of threads of the pool
+ */
+int av_executor_get_nb_threads(const AVExecutor *e);
+
+/**
+ * Run func for nb_jobs jobs and wait for all of them to finish.
+ *
+ * The calling thread runs jobs as well, so that an execute always makes
+ * progress even when all the threads of the pool are busy. When several
+ * executes are pending, the free threads take the jobs of the one with
+ * the highest priority first, then of the oldest one.
+ *
+ * @param ret         array of nb_jobs return values of func, may be NULL
+ * @param max_threads maximum number of threads running jobs of this execute
+ *                    at the same time, the calling thread included
+ * @param priority    priority of the execute, higher values first
+ * @return 0
+ */
+int av_executor_execute(AVExecutor *e, AVExecutorFunc *func, void *ctx,
+                        void *arg, int *ret, int nb_jobs, int max_threads,
+                        int priority);
+
+#endif /* AVUTIL_EXECUTOR_H */
@@ -106,6 +106,12 @@ crc(){
     ffmpeg "$@" -f crc -
 }
 
+command_replies(){
+    ffmpeg -v verbose "$@" -f null - 2>&1 |
+        sed -n -e 's/^\[[^]]*\] \(Command reply .*\)/\1/p' \
+               -e 's/^\[[^]]*\] \(Switched to .*\)/\1/p'
+}
+
 md5(){
     ffmpeg "$@" md5:
 }
@@ -46,3 +46,34 @@ fate-unknown_layout-ac3: $(AREF)
 fate-unknown_layout-ac3: CMD = md5 \
   -guess_layout_max 0 -f s16le -ac 1 -ar 44100 -i $(TARGET_PATH)/$(AREF) \
   -f ac3 -flags +bitexact -c ac3_fixed
+
+# -filter_pipeline and -stage_threads must not change the output. The video
+# is sent for filtering before the shorter audio stream ends at the end of
+# the input, so -shortest must not drop the frames still being filtered, and
+# decimate must not flush its last frame earlier than without threads.
+FILTER_PIPELINE_SRC = -f lavfi -i "testsrc=s=320x240:r=25:d=5[out0];sine=d=3[out1]"
+FILTER_PIPELINE_OUT = -c:v rawvideo -c:a pcm_s16le -shortest
+
+FATE_FILTER_PIPELINE-$(call ALLYES, LAVFI_INDEV TESTSRC_FILTER SINE_FILTER UNSHARP_FILTER HFLIP_FILTER NEGATE_FILTER TRANSPOSE_FILTER) += fate-ffmpeg-filter_pipeline-serial fate-ffmpeg-filter_pipeline
+fate-ffmpeg-filter_pipeline-serial: CMD = framecrc $(FILTER_PIPELINE_SRC) -vf unsharp,hflip,negate,transpose $(FILTER_PIPELINE_OUT)
+fate-ffmpeg-filter_pipeline: CMD = framecrc -filter_pipeline $(FILTER_PIPELINE_SRC) -vf unsharp,hflip,negate,transpose $(FILTER_PIPELINE_OUT)
+fate-ffmpeg-filter_pipeline: REF = $(SRC_PATH)/tests/ref/fate/ffmpeg-filter_pipeline-serial
+
+FATE_FILTER_PIPELINE-$(call ALLYES, LAVFI_INDEV TESTSRC_FILTER SINE_FILTER TELECINE_FILTER FIELDMATCH_FILTER DECIMATE_FILTER) += fate-ffmpeg-filter_pipeline-flush-serial fate-ffmpeg-filter_pipeline-flush
+fate-ffmpeg-filter_pipeline-flush-serial: CMD = framecrc $(FILTER_PIPELINE_SRC) -vf telecine,fieldmatch,decimate $(FILTER_PIPELINE_OUT)
+fate-ffmpeg-filter_pipeline-flush: CMD = framecrc -filter_pipeline $(FILTER_PIPELINE_SRC) -vf telecine,fieldmatch,decimate $(FILTER_PIPELINE_OUT)
+fate-ffmpeg-filter_pipeline-flush: REF = $(SRC_PATH)/tests/ref/fate/ffmpeg-filter_pipeline-flush-serial
+
+FATE_FFMPEG += $(FATE_FILTER_PIPELINE-yes)
+fate-filter_pipeline: $(FATE_FILTER_PIPELINE-yes)
+
+FATE_STAGE_THREADS-$(call ALLYES, LAVFI_INDEV TESTSRC_FILTER SINE_FILTER UNSHARP_FILTER HFLIP_FILTER NEGATE_FILTER TRANSPOSE_FILTER) += fate-ffmpeg-stage_threads
+fate-ffmpeg-stage_threads: CMD = framecrc -stage_threads -filter_threads 3 $(FILTER_PIPELINE_SRC) -vf unsharp,hflip,negate,transpose $(FILTER_PIPELINE_OUT)
+fate-ffmpeg-stage_threads: REF = $(SRC_PATH)/tests/ref/fate/ffmpeg-filter_pipeline-serial
+
+FATE_STAGE_THREADS-$(call ALLYES, LAVFI_INDEV TESTSRC_FILTER SINE_FILTER TELECINE_FILTER FIELDMATCH_FILTER DECIMATE_FILTER) += fate-ffmpeg-stage_threads-flush
+fate-ffmpeg-stage_threads-flush: CMD = framecrc -stage_threads -filter_threads 3 $(FILTER_PIPELINE_SRC) -vf telecine,fieldmatch,decimate $(FILTER_PIPELINE_OUT)
+fate-ffmpeg-stage_threads-flush: REF = $(SRC_PATH)/tests/ref/fate/ffmpeg-filter_pipeline-flush-serial
+
+FATE_FFMPEG += $(FATE_STAGE_THREADS-yes)
+fate-stage_threads: $(FATE_STAGE_THREADS-yes)
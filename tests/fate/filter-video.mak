@@ -397,6 +397,72 @@ $(FATE_FILTER_VSYNTH-yes): SRC = $(TARGET_PATH)/tests/vsynth1/%02d.pgm
 
 FATE_AVCONV-$(call DEMDEC, IMAGE2, PGMYUV) += $(FATE_FILTER_VSYNTH-yes)
 
+FATE_FILTER_UNWARPVR-$(CONFIG_UNWARPVR_FILTER) += fate-filter-unwarpvr-inverse
+fate-filter-unwarpvr-inverse: libavfilter/vf_unwarpvr-test$(EXESUF)
+fate-filter-unwarpvr-inverse: CMD = run libavfilter/vf_unwarpvr-test
+fate-filter-unwarpvr-inverse: REF = /dev/null
+
+# The scales zoom out so that the small frames still show the whole lens
+UNWARPVR_SRC  = -f lavfi -i testsrc=s=320x180:r=5:d=0.6
+UNWARPVR_ARGS = 322:182:eye_relief_dial=3:scale_width=0.17:scale_height=0.17
+
+define FATE_UNWARPVR_FMT_SUITE
+FATE_FILTER_UNWARPVR-$(CONFIG_UNWARPVR_FILTER) += fate-filter-unwarpvr-$(1)-$(2)
+fate-filter-unwarpvr-$(1)-$(2): CMD = framecrc $(UNWARPVR_SRC) -vf format=$(1),unwarpvr=$(UNWARPVR_ARGS):interp=$(2) -sws_flags +accurate_rnd+bitexact
+endef
+
+define FATE_UNWARPVR_MODE_SUITE
+FATE_FILTER_UNWARPVR-$(CONFIG_UNWARPVR_FILTER) += fate-filter-unwarpvr-$(1)
+fate-filter-unwarpvr-$(1): CMD = framecrc $(UNWARPVR_SRC) -vf format=rgb24,unwarpvr=322:182:eye_relief_dial=3:$(2) -sws_flags +accurate_rnd+bitexact
+endef
+
+UNWARPVR_FMTS = rgb24 bgr24 rgba bgra abgr argb 0bgr 0rgb rgb0 bgr0 rgb48le bgr48le \
+                gbrp gbrp10le yuv420p yuv422p yuv444p yuvj420p yuvj422p yuvj444p
+UNWARPVR_INTERPS = nearest bilinear bicubic
+
+# swscale cannot output gbrp16, so the planes are rearranged from rgb48le
+define FATE_UNWARPVR_GBRP16_SUITE
+FATE_FILTER_UNWARPVR-$(call ALLYES, UNWARPVR_FILTER EXTRACTPLANES_FILTER MERGEPLANES_FILTER) += fate-filter-unwarpvr-gbrp16le-$(1)
+fate-filter-unwarpvr-gbrp16le-$(1): CMD = framecrc $(UNWARPVR_SRC) -filter_complex "format=rgb48le,extractplanes=r+g+b[r][g][b]\;[r][g][b]mergeplanes=0x102000:gbrp16le,unwarpvr=$(UNWARPVR_ARGS):interp=$(1)" -sws_flags +accurate_rnd+bitexact
+endef
+
+$(foreach FMT,$(UNWARPVR_FMTS),$(foreach INTERP,$(UNWARPVR_INTERPS),$(eval $(call FATE_UNWARPVR_FMT_SUITE,$(FMT),$(INTERP)))))
+$(foreach INTERP,$(UNWARPVR_INTERPS),$(eval $(call FATE_UNWARPVR_GBRP16_SUITE,$(INTERP))))
+$(foreach INTERP,$(UNWARPVR_INTERPS),$(eval $(call FATE_UNWARPVR_MODE_SUITE,dk1-$(INTERP),device=RiftDK1:scale_width=0.25:scale_height=0.25:interp=$(INTERP))))
+$(foreach INTERP,$(UNWARPVR_INTERPS),$(eval $(call FATE_UNWARPVR_MODE_SUITE,forward-$(INTERP),forward_warp=1:scale_in_width=0.17:scale_in_height=0.17:interp=$(INTERP))))
+$(foreach INTERP,$(UNWARPVR_INTERPS),$(eval $(call FATE_UNWARPVR_MODE_SUITE,forward-dk1-$(INTERP),device=RiftDK1:forward_warp=1:scale_in_width=0.25:scale_in_height=0.25:interp=$(INTERP))))
+
+$(eval $(call FATE_UNWARPVR_MODE_SUITE,compact,scale_width=0.17:scale_height=0.17:interp=bilinear:compact=1))
+$(eval $(call FATE_UNWARPVR_MODE_SUITE,symmetric,scale_width=0.17:scale_height=0.17:interp=bicubic:symmetric=1))
+$(eval $(call FATE_UNWARPVR_MODE_SUITE,swap-eyes,scale_width=0.17:scale_height=0.17:swap_eyes=1))
+$(eval $(call FATE_UNWARPVR_MODE_SUITE,mono-input,scale_width=0.17:scale_height=0.17:mono_input=1))
+$(eval $(call FATE_UNWARPVR_MODE_SUITE,left-eye-only,scale_width=0.17:scale_height=0.17:left_eye_only=1))
+$(eval $(call FATE_UNWARPVR_MODE_SUITE,equirect,scale_width=0.17:scale_height=0.17:interp=bilinear:projection=equirect))
+$(eval $(call FATE_UNWARPVR_MODE_SUITE,cubemap,interp=bilinear:projection=cubemap))
+$(eval $(call FATE_UNWARPVR_MODE_SUITE,out-pix-fmt,scale_width=0.17:scale_height=0.17:interp=bilinear:out_pix_fmt=yuv420p))
+$(eval $(call FATE_UNWARPVR_MODE_SUITE,outputs-left,scale_width=0.17:scale_height=0.17:outputs=left))
+$(eval $(call FATE_UNWARPVR_MODE_SUITE,outputs-right,scale_width=0.17:scale_height=0.17:outputs=right))
+
+FATE_FILTER_UNWARPVR-$(CONFIG_UNWARPVR_FILTER) += fate-filter-unwarpvr-both-eyes
+fate-filter-unwarpvr-both-eyes: CMD = framecrc $(UNWARPVR_SRC) -filter_complex format=rgb24,unwarpvr=$(UNWARPVR_ARGS):outputs=both_eyes[l][r] -map [l] -map [r] -sws_flags +accurate_rnd+bitexact
+
+FATE_FILTER_UNWARPVR-$(CONFIG_UNWARPVR_FILTER) += fate-filter-unwarpvr-skip-static
+fate-filter-unwarpvr-skip-static: CMD = framecrc -f lavfi -i testsrc=s=320x180:r=1:d=2,fps=5 -vf format=rgb24,unwarpvr=$(UNWARPVR_ARGS):skip_static=1 -sws_flags +accurate_rnd+bitexact
+
+UNWARPVR_STATIC_SRC = -f lavfi -i testsrc=s=320x180:r=1:d=2,fps=5
+
+FATE_FILTER_UNWARPVR-$(call ALLYES, UNWARPVR_FILTER SENDCMD_FILTER) += fate-filter-unwarpvr-sendcmd fate-filter-unwarpvr-sendcmd-replies
+fate-filter-unwarpvr-sendcmd fate-filter-unwarpvr-sendcmd-replies: tests/data/filtergraphs/unwarpvr_sendcmd
+fate-filter-unwarpvr-sendcmd: CMD = framecrc $(UNWARPVR_STATIC_SRC) -filter_script $(TARGET_PATH)/tests/data/filtergraphs/unwarpvr_sendcmd -sws_flags +accurate_rnd+bitexact
+fate-filter-unwarpvr-sendcmd-replies: CMD = command_replies $(UNWARPVR_STATIC_SRC) -filter_script $(TARGET_PATH)/tests/data/filtergraphs/unwarpvr_sendcmd -sws_flags +accurate_rnd+bitexact
+
+FATE_FILTER_UNWARPVR-$(call ALLYES, UNWARPVR_FILTER SENDCMD_FILTER) += fate-filter-unwarpvr-sendcmd-ppd
+fate-filter-unwarpvr-sendcmd-ppd: tests/data/filtergraphs/unwarpvr_sendcmd_ppd
+fate-filter-unwarpvr-sendcmd-ppd: CMD = framecrc $(UNWARPVR_STATIC_SRC) -filter_script $(TARGET_PATH)/tests/data/filtergraphs/unwarpvr_sendcmd_ppd -sws_flags +accurate_rnd+bitexact
+
+FATE-yes += $(FATE_FILTER_UNWARPVR-yes)
+fate-filter-unwarpvr: $(FATE_FILTER_UNWARPVR-yes)
+
 #
 # Metadata tests
 #
@@ -57,6 +57,10 @@ FATE_LIBAVUTIL += fate-eval
 fate-eval: libavutil/eval-test$(EXESUF)
 fate-eval: CMD = run libavutil/eval-test
 
+FATE_LIBAVUTIL-$(HAVE_THREADS) += fate-executor
+fate-executor: libavutil/executor-test$(EXESUF)
+fate-executor: CMD = run libavutil/executor-test
+
 FATE_LIBAVUTIL += fate-fifo
 fate-fifo: libavutil/fifo-test$(EXESUF)
 fate-fifo: CMD = run libavutil/fifo-test
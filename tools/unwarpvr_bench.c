@@ -0,0 +1,267 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Benchmark for the unwarpvr filter.
+ *
+ * Feeds synthetic frames through buffer -> unwarpvr -> buffersink and
+ * reports the time spent building the remap table separately from the
+ * per-frame remap time.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/cpu.h"
+#include "libavutil/frame.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/pixdesc.h"
+#include "libavutil/time.h"
+#include "libavfilter/avfilter.h"
+#include "libavfilter/buffersink.h"
+#include "libavfilter/buffersrc.h"
+
+#if HAVE_UNISTD_H
+#include <unistd.h> /* for getopt */
+#endif
+#if !HAVE_GETOPT
+#include "compat/getopt.c"
+#endif
+
+#define MAX_OUTPUTS 2
+
+static int table_bytes = -1;
+
+static void usage(void)
+{
+    printf("Usage: unwarpvr_bench [options] [unwarpvr options]\n"
+           "Options:\n"
+           "  -s WxH      input size (default 1920x1080)\n"
+           "  -p pix_fmt  input pixel format (default rgb24)\n"
+           "  -n frames   number of timed frames (default 100)\n"
+           "  -w frames   number of untimed warm-up frames (default 2)\n"
+           "  -t threads  number of filter threads, 0 for auto (default 0)\n"
+           "  -c flags    force cpu flags, e.g. 0 for the C code only\n"
+           "  -S          send the same frame every time instead of\n"
+           "              alternating between two different ones\n"
+           "  -h          print this help\n"
+           "\n"
+           "Example: unwarpvr_bench -s 3840x2160 -t 4 2364:1461:interp=bilinear\n");
+}
+
+/* Catch the table size logged by the filter, and pass everything on. */
+static void log_callback(void *avcl, int level, const char *fmt, va_list vl)
+{
+    if (!strcmp(fmt, "Remap table: %d bytes\n")) {
+        va_list vl2;
+        va_copy(vl2, vl);
+        table_bytes = va_arg(vl2, int);
+        va_end(vl2);
+    }
+    av_log_default_callback(avcl, level, fmt, vl);
+}
+
+static AVFrame *make_frame(int w, int h, enum AVPixelFormat pix_fmt, int seed)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+    int depth = desc->comp[0].depth_minus1 + 1;
+    AVFrame *frame = av_frame_alloc();
+    int p, x, y;
+
+    if (!frame)
+        return NULL;
+    frame->width  = w;
+    frame->height = h;
+    frame->format = pix_fmt;
+    if (av_frame_get_buffer(frame, 32) < 0) {
+        av_frame_free(&frame);
+        return NULL;
+    }
+
+    /* a diagonal pattern, so that neighbouring samples differ */
+    for (p = 0; p < 4 && frame->data[p]; p++) {
+        int ph = p == 1 || p == 2 ? FF_CEIL_RSHIFT(h, desc->log2_chroma_h) : h;
+        for (y = 0; y < ph; y++) {
+            uint8_t *row = frame->data[p] + y * frame->linesize[p];
+            if (depth > 8) {
+                for (x = 0; x < frame->linesize[p] / 2; x++)
+                    AV_WN16(row + 2 * x, ((x + y) * 3 + seed) & ((1 << depth) - 1));
+            } else {
+                for (x = 0; x < frame->linesize[p]; x++)
+                    row[x] = (x + y) * 3 + seed;
+            }
+        }
+    }
+    return frame;
+}
+
+int main(int argc, char **argv)
+{
+    int w = 1920, h = 1080, nb_frames = 100, nb_warmup = 2, threads = 0;
+    int same_frame = 0;
+    enum AVPixelFormat pix_fmt = AV_PIX_FMT_RGB24;
+    const char *opts = "";
+    AVFilterGraph *graph = NULL;
+    AVFilterContext *src = NULL, *unwarpvr = NULL, *sinks[MAX_OUTPUTS];
+    AVFrame *frames[2] = { NULL }, *out = NULL;
+    int64_t t0, build_time, remap_time;
+    int64_t out_pixels = 0;
+    char args[256];
+    unsigned cpu_flags;
+    int i, j, opt, ret = 1;
+
+    while ((opt = getopt(argc, argv, "hs:p:n:w:t:c:S")) != -1) {
+        switch (opt) {
+        case 's':
+            if (sscanf(optarg, "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0) {
+                fprintf(stderr, "Invalid size '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'p':
+            pix_fmt = av_get_pix_fmt(optarg);
+            if (pix_fmt == AV_PIX_FMT_NONE) {
+                fprintf(stderr, "Unknown pixel format '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'n':
+            nb_frames = atoi(optarg);
+            break;
+        case 'w':
+            nb_warmup = atoi(optarg);
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'c':
+            if (av_parse_cpu_caps(&cpu_flags, optarg) < 0) {
+                fprintf(stderr, "Invalid cpu flags '%s'\n", optarg);
+                return 1;
+            }
+            av_force_cpu_flags(cpu_flags);
+            break;
+        case 'S':
+            same_frame = 1;
+            break;
+        case 'h':
+            usage();
+            return 0;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if (optind < argc)
+        opts = argv[optind];
+    if (nb_frames <= 0 || nb_warmup < 0) {
+        fprintf(stderr, "Invalid frame count\n");
+        return 1;
+    }
+
+    avfilter_register_all();
+    av_log_set_callback(log_callback);
+
+    graph = avfilter_graph_alloc();
+    if (!graph)
+        goto fail;
+    graph->nb_threads = threads;
+
+    snprintf(args, sizeof(args),
+             "video_size=%dx%d:pix_fmt=%d:time_base=1/25:pixel_aspect=1/1",
+             w, h, pix_fmt);
+    if (avfilter_graph_create_filter(&src, avfilter_get_by_name("buffer"),
+                                     "in", args, NULL, graph) < 0 ||
+        avfilter_graph_create_filter(&unwarpvr, avfilter_get_by_name("unwarpvr"),
+                                     "unwarpvr", opts, NULL, graph) < 0 ||
+        avfilter_link(src, 0, unwarpvr, 0) < 0) {
+        fprintf(stderr, "Could not create the unwarpvr filter with '%s'\n", opts);
+        goto fail;
+    }
+    for (i = 0; i < unwarpvr->nb_outputs; i++) {
+        if (avfilter_graph_create_filter(&sinks[i], avfilter_get_by_name("buffersink"),
+                                         NULL, NULL, NULL, graph) < 0 ||
+            avfilter_link(unwarpvr, i, sinks[i], 0) < 0)
+            goto fail;
+    }
+
+    /* configuring the graph is dominated by building the table */
+    t0 = av_gettime_relative();
+    if (avfilter_graph_config(graph, NULL) < 0) {
+        fprintf(stderr, "Could not configure the graph\n");
+        goto fail;
+    }
+    build_time = av_gettime_relative() - t0;
+
+    if (graph->nb_filters != 2 + unwarpvr->nb_outputs)
+        fprintf(stderr, "Warning: %s is not supported directly, the timings "
+                "include a conversion\n", av_get_pix_fmt_name(pix_fmt));
+
+    for (i = 0; i < unwarpvr->nb_outputs; i++)
+        out_pixels += (int64_t)sinks[i]->inputs[0]->w * sinks[i]->inputs[0]->h;
+
+    frames[0] = make_frame(w, h, pix_fmt, 0);
+    frames[1] = make_frame(w, h, pix_fmt, 1);
+    out = av_frame_alloc();
+    if (!frames[0] || !frames[1] || !out)
+        goto fail;
+
+    for (i = 0; i < nb_warmup + nb_frames; i++) {
+        AVFrame *frame = frames[same_frame ? 0 : i & 1];
+
+        if (i == nb_warmup)
+            t0 = av_gettime_relative();
+        frame->pts = i;
+        if (av_buffersrc_add_frame_flags(src, frame, AV_BUFFERSRC_FLAG_KEEP_REF) < 0) {
+            fprintf(stderr, "Error while feeding the graph\n");
+            goto fail;
+        }
+        for (j = 0; j < unwarpvr->nb_outputs; j++) {
+            while (av_buffersink_get_frame(sinks[j], out) >= 0)
+                av_frame_unref(out);
+        }
+    }
+    remap_time = av_gettime_relative() - t0;
+
+    printf("unwarpvr=%s on %dx%d %s, %d threads\n", opts, w, h,
+           av_get_pix_fmt_name(pix_fmt), unwarpvr->graph->nb_threads);
+    printf("table build: %.1f ms", build_time / 1000.0);
+    if (table_bytes >= 0)
+        printf(", table size: %d bytes", table_bytes);
+    printf("\n");
+    printf("remap: %.2f ms/frame, %.1f frames/s, %.2f ns/output pixel",
+           remap_time / 1000.0 / nb_frames,
+           nb_frames * 1000000.0 / remap_time,
+           remap_time * 1000.0 / nb_frames / out_pixels);
+    if (table_bytes >= 0)
+        printf(", %.2f table bytes/output pixel", (double)table_bytes / out_pixels);
+    printf("\n");
+    ret = 0;
+
+fail:
+    av_frame_free(&frames[0]);
+    av_frame_free(&frames[1]);
+    av_frame_free(&out);
+    avfilter_graph_free(&graph);
+    return ret;
+}